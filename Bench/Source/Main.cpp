@@ -0,0 +1,757 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 3 May 2022 10:12:45am
+    Author:  Helmer Nuijens
+
+    Headless render and benchmark tool for the string model.
+
+    StiffStringBench render <script> <out.wav> [options]
+        Renders a script to a 32 bit float WAV file and reports the timing.
+    StiffStringBench bench [options]
+        Sweeps f0, radius, sigma1, the number of voices, the block size, one string through the
+        old per sample loop against renderBlock, the sample rate, the grid of the implicit scheme,
+        the tension modulation, damping automation and strings coupled on a bridge.
+    StiffStringBench check <directory> [--record] [--baseline <file>] [--speed <fraction>] [options]
+        Renders fixed plucks, strikes and bow strokes and compares them with the reference
+        outputs in the directory, Bench/References in the repository, within 1e-6 of their peak
+        since they come from another machine. Every stencil kernel has to match the scalar one
+        exactly. Checks that the energy never grows while nothing drives the strings, that
+        threaded rendering matches, that a saved state of sounding strings continues exactly
+        after restoring it, and with --baseline that throughput stays within the fraction of the
+        baseline recorded on this machine. --record writes the references and the baseline first.
+
+    Options: --fs <Hz> --block <samples> --voices <n> --workers <n> --seconds <s>
+             --telemetry <file.csv>   records every block and prints a summary per run
+             --simfs <Hz>             runs the strings at this rate and resamples to --fs
+             --quality low|medium|high
+             --theta <0..1>           implicit scheme below 1, unconditionally stable at 0.5 or less
+             --gridscale <0..1>       grid size of the implicit scheme relative to the explicit one
+             --tension <0..1>         tension modulation of the explicit scheme, 0 is linear
+             --record                 check records new references and a new baseline
+             --baseline <file>        check compares throughput with this file, written when missing
+             --speed <fraction>       check fails below this fraction of the baseline, 0.2 is 80 %
+
+    A script has one event per line, '#' starts a comment:
+        <time in s> pluck  <note> [amp] [pos]
+        <time in s> strike <note> [amp] [pos]
+        <time in s> bow    <note> <velocity> [pos]
+        <time in s> off    <note>
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "../../Source/VoicePool.h"
+#include "../../Source/StringNetwork.h"
+#include "RegressionCheck.h"
+
+struct Settings
+{
+    double Fs = 48000.0;
+    int blockSize = 256;
+    int numVoices = 8;
+    int numWorkers = SystemStats::getNumPhysicalCpus() - 1;
+    double seconds = 5.0;
+    double simulationFs = 0.0;          // 0 runs the strings at Fs
+    Resampler::Quality quality = Resampler::medium;
+    bool modalPlucks = true;            // plucked linear voices start on the ModalString
+    bool automateDamping = false;       // sweeps sig0 every block, like host automation
+    bool record = false;                // check writes references instead of only reading them
+    std::string baselinePath;           // machine local throughput baseline of check, none skips it
+    double speedTolerance = 0.2;        // check fails below (1 - speedTolerance) of the baseline
+    StringParams params;
+    std::string telemetryPath;
+};
+
+struct ScriptEvent
+{
+    enum Type { pluck, strike, bow, off };
+
+    double time;
+    Type type;
+    int note;
+    double value;       // amplitude, or bow velocity
+    float pos;
+};
+
+struct Result
+{
+    double renderSeconds = 0.0;
+    double realTimeFactor = 0.0;        // render time / audio time
+    double samplesPerSecond = 0.0;      // output samples per second of render time
+    double p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;     // block render times in us
+};
+
+//==============================================================================
+static bool parseScript(const std::string& path, vector<ScriptEvent>& events)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        std::string type;
+        ScriptEvent event = { 0.0, ScriptEvent::pluck, 0, 1.0, 0.3f };
+
+        if (!(stream >> event.time >> type >> event.note)) continue;
+
+        if (type == "pluck" || type == "strike")
+        {
+            event.type = type == "pluck" ? ScriptEvent::pluck : ScriptEvent::strike;
+            stream >> event.value >> event.pos;
+        }
+        else if (type == "bow")
+        {
+            event.type = ScriptEvent::bow;
+            event.pos = 0.13f;
+            stream >> event.value >> event.pos;
+        }
+        else if (type == "off")
+        {
+            event.type = ScriptEvent::off;
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown event '%s'\n", type.c_str());
+            return false;
+        }
+        events.push_back(event);
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const ScriptEvent& a, const ScriptEvent& b) { return a.time < b.time; });
+    return true;
+}
+
+static void applyEvent(VoicePool& voices, const ScriptEvent& event, int offset)
+{
+    switch (event.type)
+    {
+        case ScriptEvent::pluck:
+        case ScriptEvent::strike:
+            voices.noteOn(event.note, MidiMessage::getMidiNoteInHertz(event.note));
+            voices.exciteNote(event.note, offset, event.value, event.pos, 15, event.type == ScriptEvent::strike);
+            break;
+        case ScriptEvent::bow:
+            if (!voices.isNoteActive(event.note))
+                voices.noteOn(event.note, MidiMessage::getMidiNoteInHertz(event.note));
+            voices.setBow(event.note, offset, event.value != 0.0, event.value, event.pos);
+            break;
+        case ScriptEvent::off:
+            voices.noteOff(event.note);
+            break;
+    }
+}
+
+//==============================================================================
+static Result summarize(const Settings& settings, int64 total, int numSamples, vector<double>& blockTimes)
+{
+    Result result;
+    result.renderSeconds = Time::highResolutionTicksToSeconds(total);
+    result.realTimeFactor = result.renderSeconds / settings.seconds;
+    result.samplesPerSecond = numSamples / result.renderSeconds;
+
+    std::sort(blockTimes.begin(), blockTimes.end());
+    auto percentile = [&](double p) { return blockTimes[jmin(static_cast<int> (p * blockTimes.size()), static_cast<int> (blockTimes.size()) - 1)]; };
+    result.p50 = percentile(0.5);
+    result.p90 = percentile(0.9);
+    result.p99 = percentile(0.99);
+    result.max = blockTimes.back();
+
+    return result;
+}
+
+static Result render(const Settings& settings, const vector<ScriptEvent>& events, vector<float>* output)
+{
+    // Same grid limit as the plugin
+    int maxGridSize = StiffString::calculateGridSize(jmax(settings.Fs, settings.simulationFs), MidiMessage::getMidiNoteInHertz(0), settings.params.L, 0.0, 0.0);
+    maxGridSize = jmin(maxGridSize, StiffString::maxGridSize);
+
+    VoicePool voices;
+    voices.setSimulationRate(settings.simulationFs, settings.quality);
+    voices.setModalPlucks(settings.modalPlucks);
+    voices.prepare(settings.Fs, settings.params, maxGridSize, settings.numVoices, settings.blockSize, jmax(0, settings.numWorkers));
+
+    Telemetry& telemetry = voices.getTelemetry();
+    if (!settings.telemetryPath.empty())
+    {
+        telemetry.setCsvFile(File::getCurrentWorkingDirectory().getChildFile(String(settings.telemetryPath)));
+        telemetry.setEnabled(true, voices.getSimulationRate());
+    }
+
+    const int numSamples = static_cast<int> (settings.seconds * settings.Fs);
+    const int numBlocks = (numSamples + settings.blockSize - 1) / settings.blockSize;
+    vector<float> block(settings.blockSize, 0.0f);
+    vector<double> blockTimes;
+    blockTimes.reserve(numBlocks);
+    if (output != nullptr) output->assign(numSamples, 0.0f);
+
+    size_t next = 0;
+    int64 total = 0;
+
+    for (int start = 0; start < numSamples; start += settings.blockSize)
+    {
+        const int blockSize = jmin(settings.blockSize, numSamples - start);
+
+        // Events are delivered like MIDI, with their offset into the block
+        while (next < events.size() && static_cast<int> (events[next].time * settings.Fs) < start + blockSize)
+        {
+            applyEvent(voices, events[next], jmax(0, static_cast<int> (events[next].time * settings.Fs) - start));
+            ++next;
+        }
+
+        StringParams params = settings.params;
+        if (settings.automateDamping)
+            params.sig0 *= 1.0 + 0.5 * std::sin(2.0 * double_Pi * start / settings.Fs);
+
+        std::fill(block.begin(), block.end(), 0.0f);
+        int64 before = Time::getHighResolutionTicks();
+        if (settings.automateDamping) voices.updateGrids(params);
+        voices.process(block.data(), nullptr, blockSize);
+        int64 ticks = Time::getHighResolutionTicks() - before;
+
+        total += ticks;
+        blockTimes.push_back(Time::highResolutionTicksToSeconds(ticks) * 1e6);
+        if (output != nullptr) std::copy(block.begin(), block.begin() + blockSize, output->begin() + start);
+    }
+
+    voices.releaseResources();
+
+    if (telemetry.isEnabled())
+    {
+        Telemetry::Summary summary = telemetry.getSummary();
+        std::printf("telemetry: %lld blocks, %lld dropped, mean %.1f us, max %.1f us, max load %.2f, "
+                    "max bow iterations %d, %lld rebuilds, max N %d\n",
+                    static_cast<long long> (summary.numBlocks), static_cast<long long> (summary.numDropped),
+                    summary.meanMicroseconds, summary.maxMicroseconds, summary.maxLoad, summary.maxBowIterations,
+                    static_cast<long long> (summary.numRebuilds), summary.maxGridSize);
+        telemetry.setEnabled(false, voices.getSimulationRate());
+    }
+
+    return summarize(settings, total, numSamples, blockTimes);
+}
+
+static Result renderNetwork(const Settings& settings, int numStrings)
+{
+    // Strings a semitone apart on one bridge, the first is plucked and rattles against a fixed point
+    int maxGridSize = jmin(StiffString::calculateGridSize(settings.Fs, MidiMessage::getMidiNoteInHertz(0), settings.params.L, 0.0, 0.0), StiffString::maxGridSize);
+
+    StringNetwork network;
+    network.prepare(settings.Fs, maxGridSize);
+    network.setBridge(0.05, 150.0, 30.0);
+
+    CoefficientCache cache;
+    cache.build(settings.Fs, settings.params, maxGridSize);
+    for (int s = 0; s < numStrings; ++s)
+    {
+        StringNetwork::Connection connection;
+        connection.stringA = network.addString(cache.getNote(45 + s));
+        connection.posA = 0.9f;
+        connection.stringB = StringNetwork::bridge;
+        connection.K1 = 5e4;
+        connection.R = 1.0;
+        network.addConnection(connection);
+    }
+
+    StringNetwork::Connection rattle;
+    rattle.type = StringNetwork::Connection::rattle;
+    rattle.posA = 0.2f;
+    rattle.stringB = StringNetwork::ground;
+    rattle.K1 = 1e6;
+    rattle.gap = 1e-5;
+    network.addConnection(rattle);
+
+    Pickups pickups;
+    Pickups::Pickup taps[2] = { { 0.2f, 0.3f }, { 0.67f, 0.7f } };
+    pickups.setPickups(taps, 2);
+    network.setPickups(pickups);
+    network.getString(0).exciteSystem(1.0, 0.3f, 15, false);
+
+    const int numSamples = static_cast<int> (settings.seconds * settings.Fs);
+    vector<float> block(settings.blockSize, 0.0f);
+    vector<double> blockTimes;
+    int64 total = 0;
+
+    for (int start = 0; start < numSamples; start += settings.blockSize)
+    {
+        const int blockSize = jmin(settings.blockSize, numSamples - start);
+        int64 before = Time::getHighResolutionTicks();
+        network.renderBlock(block.data(), nullptr, blockSize);
+        int64 ticks = Time::getHighResolutionTicks() - before;
+
+        total += ticks;
+        blockTimes.push_back(Time::highResolutionTicksToSeconds(ticks) * 1e6);
+    }
+
+    return summarize(settings, total, numSamples, blockTimes);
+}
+
+// The sample loop the plugin had before StiffString::renderBlock, kept to measure against: one
+// call per sample through the vector of state pointers, the boundaries updated on their own
+struct PerSampleString
+{
+    void setGrid(const GridCoefficients& grid)
+    {
+        g = grid;
+        uStates = vector<vector<double>>(3, vector<double>(grid.N + 1, 0.0));
+        u.resize(3);
+        for (int i = 0; i < 3; ++i)
+            u[i] = &uStates[i][0];
+    };
+
+    void exciteSystem(double amp, float pos, int width)
+    {
+        int start = jmax(1, static_cast<int> (floor(g.N * pos)) - width / 2);
+        for (int l = start; l < jmin(g.N, start + width); ++l)
+        {
+            double value = amp * 0.5 * (1.0 - cos(2.0 * double_Pi * (l - start) / (width - 1.0))) / 500.0;
+            u[1][l] += value;
+            u[2][l] += value;
+        }
+    };
+
+    double getNextSample(float outputPos)
+    {
+        const int N = g.N;
+        for (int l = 2; l < N - 1; l++)
+        {
+            u[0][l] = g.G0_0 * u[1][l] + g.G0_1 * (u[1][l - 1] + u[1][l + 1]) + g.G0_2 * (u[1][l - 2] + u[1][l + 2])
+                + g.G1_0 * u[2][l] + g.G1_1 * (u[2][l - 1] + u[2][l + 1]);
+        }
+        u[0][1] = g.G0_0 * u[1][1] + g.G0_1 * (u[1][2]) + g.G0_2 * (u[1][3])
+            + g.G1_0 * u[2][1] + g.G1_1 * (u[2][2]);
+        u[0][N - 1] = g.G0_0 * u[1][N - 1] + g.G0_1 * (u[1][N - 2]) + g.G0_2 * (u[1][N - 3])
+            + g.G1_0 * u[2][N - 1] + g.G1_1 * (u[2][N - 2]);
+
+        double out = u[0][static_cast<int> (round(outputPos * N))] * 500.0;
+        double* uTmp = u[2];
+        u[2] = u[1];
+        u[1] = u[0];
+        u[0] = uTmp;
+        return out;
+    };
+
+    GridCoefficients g {};
+    vector<vector<double>> uStates;
+    vector<double*> u;
+};
+
+static Result renderSingle(const Settings& settings, bool perSample, StencilKernel::Type kernel)
+{
+    // One plucked string at 110 Hz, through the old sample loop or renderBlock with the kernel
+    int maxGridSize = jmin(StiffString::calculateGridSize(settings.Fs, MidiMessage::getMidiNoteInHertz(0), settings.params.L, 0.0, 0.0), StiffString::maxGridSize);
+    CoefficientCache cache;
+    cache.build(settings.Fs, settings.params, maxGridSize);
+    const GridCoefficients grid = cache.getFrequency(110.0);
+
+    PerSampleString old;
+    StiffString string;
+    if (perSample)
+    {
+        old.setGrid(grid);
+        old.exciteSystem(1.0, 0.3f, 15);
+    }
+    else
+    {
+        string.setFs(settings.Fs);
+        string.allocateGrid(maxGridSize);
+        string.setKernel(kernel);
+        string.setGrid(grid);
+        string.exciteSystem(1.0, 0.3f, 15, false);
+    }
+
+    const int numSamples = static_cast<int> (settings.seconds * settings.Fs);
+    vector<float> block(settings.blockSize, 0.0f);
+    vector<double> blockTimes;
+    int64 total = 0;
+
+    for (int start = 0; start < numSamples; start += settings.blockSize)
+    {
+        const int blockSize = jmin(settings.blockSize, numSamples - start);
+        int64 before = Time::getHighResolutionTicks();
+        if (perSample)
+        {
+            for (int n = 0; n < blockSize; ++n)
+                block[n] = static_cast<float> (old.getNextSample(0.3f));
+        }
+        else string.renderBlock(block.data(), nullptr, blockSize);
+        int64 ticks = Time::getHighResolutionTicks() - before;
+
+        total += ticks;
+        blockTimes.push_back(Time::highResolutionTicksToSeconds(ticks) * 1e6);
+    }
+
+    return summarize(settings, total, numSamples, blockTimes);
+}
+
+static vector<ScriptEvent> chord(int numVoices, int lowestNote)
+{
+    // Even voices are plucked and odd voices bowed, so the bow solver is part of every run
+    vector<ScriptEvent> events;
+    for (int v = 0; v < numVoices; ++v)
+    {
+        if (v % 2 == 0) events.push_back({ 0.0, ScriptEvent::pluck, lowestNote + v, 1.0, 0.3f });
+        else events.push_back({ 0.0, ScriptEvent::bow, lowestNote + v, 0.2, 0.13f });
+    }
+    return events;
+}
+
+static void printHeader()
+{
+    std::printf("%-24s %10s %10s %12s %9s %9s %9s %9s\n", "run", "render s", "rt factor", "samples/s", "p50 us", "p90 us", "p99 us", "max us");
+}
+
+static void printResult(const std::string& name, const Result& result)
+{
+    std::printf("%-24s %10.4f %10.4f %12.0f %9.1f %9.1f %9.1f %9.1f\n", name.c_str(), result.renderSeconds, result.realTimeFactor,
+                result.samplesPerSecond, result.p50, result.p90, result.p99, result.max);
+}
+
+//==============================================================================
+static bool writeWav(const std::string& path, const vector<float>& samples, double Fs)
+{
+    File file = File::getCurrentWorkingDirectory().getChildFile(String(path));
+    file.deleteFile();
+
+    WavAudioFormat wav;
+    std::unique_ptr<FileOutputStream> stream(new FileOutputStream(file));
+    if (!stream->openedOk()) return false;
+
+    std::unique_ptr<AudioFormatWriter> writer(wav.createWriterFor(stream.get(), Fs, 1, 32, {}, 0));
+    if (writer == nullptr) return false;
+    stream.release();   // owned by the writer
+
+    float* channels[] = { const_cast<float*> (samples.data()) };
+    AudioBuffer<float> buffer(channels, 1, static_cast<int> (samples.size()));
+    return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+}
+
+static int runRender(const Settings& settings, const std::string& scriptPath, const std::string& outPath)
+{
+    vector<ScriptEvent> events;
+    if (!parseScript(scriptPath, events))
+    {
+        std::fprintf(stderr, "Could not read script %s\n", scriptPath.c_str());
+        return 1;
+    }
+
+    vector<float> output;
+    Result result = render(settings, events, &output);
+
+    if (!writeWav(outPath, output, settings.Fs))
+    {
+        std::fprintf(stderr, "Could not write %s\n", outPath.c_str());
+        return 1;
+    }
+
+    printHeader();
+    printResult(scriptPath, result);
+    return 0;
+}
+
+static int runBench(const Settings& defaults)
+{
+    // One parameter changes at a time, the rest stays at the defaults
+    printHeader();
+
+    for (double f0 : { 55.0, 110.0, 220.0, 440.0, 880.0, 1760.0 })
+    {
+        Settings settings = defaults;
+        settings.numVoices = 1;
+        int note = static_cast<int> (std::round(69.0 + 12.0 * std::log2(f0 / 440.0)));
+        printResult("f0 " + std::to_string(static_cast<int> (f0)), render(settings, chord(1, note), nullptr));
+    }
+
+    for (double radius : { 0.25, 0.5, 1.0, 2.0 })
+    {
+        Settings settings = defaults;
+        settings.numVoices = 1;
+        settings.params.r = radius * 0.001;
+        printResult("radius " + std::to_string(radius).substr(0, 4) + " mm", render(settings, chord(1, 57), nullptr));
+    }
+
+    for (double sig1 : { 0.0, 0.001, 0.005, 0.05 })
+    {
+        Settings settings = defaults;
+        settings.numVoices = 1;
+        settings.params.sig1 = sig1;
+        printResult("sigma1 " + std::to_string(sig1).substr(0, 5), render(settings, chord(1, 57), nullptr));
+    }
+
+    for (int numVoices : { 1, 2, 4, 8, 16 })
+    {
+        Settings settings = defaults;
+        settings.numVoices = numVoices;
+        printResult("voices " + std::to_string(numVoices), render(settings, chord(numVoices, 45), nullptr));
+    }
+
+    for (int blockSize : { 32, 64, 128, 256, 512, 1024 })
+    {
+        Settings settings = defaults;
+        settings.blockSize = blockSize;
+        printResult("block " + std::to_string(blockSize), render(settings, chord(settings.numVoices, 45), nullptr));
+    }
+
+    for (int blockSize : { 32, 64, 128, 256, 512, 1024 })
+    {
+        // One string through the sample loop the plugin used to have, then renderBlock with the
+        // scalar and the best kernel
+        Settings settings = defaults;
+        settings.blockSize = blockSize;
+        const std::string block = " " + std::to_string(blockSize);
+        printResult("per sample" + block, renderSingle(settings, true, StencilKernel::scalar));
+        printResult("block scalar" + block, renderSingle(settings, false, StencilKernel::scalar));
+        printResult("block best" + block, renderSingle(settings, false, StencilKernel::getBestType()));
+    }
+
+    for (double Fs : { 48000.0, 96000.0, 192000.0 })
+    {
+        // The same chord at the host rate and at 48 kHz with every resampler quality
+        Settings settings = defaults;
+        settings.Fs = Fs;
+        printResult("fs " + std::to_string(static_cast<int> (Fs)), render(settings, chord(settings.numVoices, 45), nullptr));
+
+        if (Fs == 48000.0) continue;
+        const char* names[] = { "low", "medium", "high" };
+        for (auto quality : { Resampler::low, Resampler::medium, Resampler::high })
+        {
+            settings.simulationFs = 48000.0;
+            settings.quality = quality;
+            printResult("fs " + std::to_string(static_cast<int> (Fs)) + " at 48k " + names[quality],
+                        render(settings, chord(settings.numVoices, 45), nullptr));
+        }
+    }
+
+    for (double gridScale : { 0.0, 1.0, 0.5, 0.25 })
+    {
+        // A thick, stiff bowed string with the explicit scheme, then the implicit scheme on coarser grids
+        Settings settings = defaults;
+        settings.params.r = 0.002;
+        settings.params.theta = gridScale > 0.0 ? 0.5 : 1.0;
+        settings.params.gridScale = jmax(gridScale, 0.01);
+        std::string name = gridScale > 0.0 ? "implicit grid " + std::to_string(gridScale).substr(0, 4) : "explicit r 2 mm";
+        printResult(name, render(settings, chord(2, 32), nullptr));
+    }
+
+    for (double tension : { 0.0, 1.0 })
+    {
+        // Plucks on the grid, linear and with the tension modulation
+        Settings settings = defaults;
+        settings.modalPlucks = false;
+        settings.params.tension = tension;
+        printResult(tension > 0.0 ? "tension modulation" : "linear grid plucks", render(settings, chord(settings.numVoices, 45), nullptr));
+    }
+
+    {
+        // The same plucks with sig0 changing every block, the strings glide instead of being rebuilt
+        Settings settings = defaults;
+        settings.modalPlucks = false;
+        settings.automateDamping = true;
+        printResult("damping automation", render(settings, chord(settings.numVoices, 45), nullptr));
+    }
+
+    for (int numStrings : { 6, 12 })
+        printResult("network " + std::to_string(numStrings), renderNetwork(defaults, numStrings));
+
+    return 0;
+}
+
+static int runCheck(const Settings& settings, const std::string& directory)
+{
+    // The references come from the double precision scalar kernel, which renders the energy check
+    // as well. It has to stay within the tolerance of the references recorded on another machine,
+    // every other kernel has to match it exactly, the single precision string in its envelope. A
+    // bowed string can settle into another kind of motion from rounding alone, so single precision
+    // is only compared on plucks and strikes
+    File folder = File::getCurrentWorkingDirectory().getChildFile(String(directory));
+    if (settings.record && !folder.createDirectory().wasOk())
+    {
+        std::fprintf(stderr, "Could not create %s\n", directory.c_str());
+        return 1;
+    }
+
+    const auto bestType = StencilKernel::getBestType();
+    const auto cases = RegressionCheck::getCases();
+    int numFailures = 0;
+
+    std::printf("%-24s %12s %12s %12s %12s  %s\n", "case", "double err", "kernel err", "float env", "energy rise", "result");
+    for (auto& c : cases)
+    {
+        std::string fileName = c.name + ".f32";
+        std::replace(fileName.begin(), fileName.end(), ' ', '_');
+        File file = folder.getChildFile(String(fileName));
+
+        double energyRise = 0.0;
+        vector<float> output = RegressionCheck::render(c, StencilKernel::scalar, false, &energyRise);
+        vector<float> reference;
+        if (settings.record && !RegressionCheck::writeReference(file, output))
+        {
+            std::fprintf(stderr, "Could not write %s\n", fileName.c_str());
+            return 1;
+        }
+        if (!RegressionCheck::readReference(file, reference))
+        {
+            std::printf("%-24s %12s %12s %12s %12s  FAIL, no reference\n", c.name.c_str(), "-", "-", "-", "-");
+            ++numFailures;
+            continue;
+        }
+
+        double doubleError = RegressionCheck::compare(output, reference);
+        double kernelError = 0.0;
+        for (int type = StencilKernel::sse2; type <= bestType; ++type)
+            kernelError = jmax(kernelError, RegressionCheck::compare(RegressionCheck::render(c, static_cast<StencilKernel::Type> (type), false), output));
+        double floatError = 0.0;
+        if (c.excitation != RegressionCheck::bow)
+            floatError = RegressionCheck::compareEnvelope(RegressionCheck::render(c, bestType, true), reference,
+                                                          static_cast<int> (RegressionCheck::frameSeconds * c.Fs));
+
+        bool passed = doubleError <= RegressionCheck::doubleTolerance && kernelError == 0.0 && floatError <= RegressionCheck::floatTolerance
+                   && energyRise <= RegressionCheck::energyTolerance;
+        if (!passed) ++numFailures;
+        char floatColumn[16] = "-";
+        if (c.excitation != RegressionCheck::bow) std::snprintf(floatColumn, sizeof(floatColumn), "%.3g", floatError);
+        std::printf("%-24s %12.3g %12.3g %12s %12.3g  %s\n", c.name.c_str(), doubleError, kernelError, floatColumn, energyRise, passed ? "ok" : "FAIL");
+    }
+
+    {
+        // The voice pool spread over workers has to render exactly what the audio thread renders alone
+        Settings single = settings;
+        single.seconds = 1.0;
+        single.numWorkers = 0;
+        Settings threaded = single;
+        threaded.numWorkers = jmax(1, settings.numWorkers);
+
+        vector<float> reference, output;
+        render(single, chord(single.numVoices, 45), &reference);
+        render(threaded, chord(threaded.numVoices, 45), &output);
+        double error = RegressionCheck::compare(output, reference);
+
+        bool passed = error == 0.0;
+        if (!passed) ++numFailures;
+        std::printf("%-24s %12.3g %12s %12s %12s  %s\n", "voices threaded", error, "-", "-", "-", passed ? "ok" : "FAIL");
+    }
+
+    {
+        // Sounding strings written by the plugin state and read back into a new pool have to
+        // continue exactly. Note 128 is the voice of the plugin parameters, off the MIDI table
+        Settings state = settings;
+        state.seconds = 0.2;
+        int maxGridSize = jmin(StiffString::calculateGridSize(state.Fs, MidiMessage::getMidiNoteInHertz(0), state.params.L, 0.0, 0.0), StiffString::maxGridSize);
+        const int numSamples = static_cast<int> (state.seconds * state.Fs);
+
+        VoicePool voices, restored;
+        for (auto* pool : { &voices, &restored })
+        {
+            pool->setModalPlucks(false);
+            pool->prepare(state.Fs, state.params, maxGridSize, state.numVoices, state.blockSize, 0);
+        }
+        voices.noteOn(128, 196.5);
+        voices.exciteNote(128, 0, 1.0, 0.3f, 15, false);
+        voices.noteOn(45, MidiMessage::getMidiNoteInHertz(45));
+        voices.setBow(45, 0, true, 0.2, 0.13f);
+
+        vector<float> block(state.blockSize, 0.0f), reference, output;
+        auto renderPool = [&](VoicePool& pool, vector<float>& samples)
+        {
+            samples.clear();
+            for (int start = 0; start < numSamples; start += state.blockSize)
+            {
+                std::fill(block.begin(), block.end(), 0.0f);
+                pool.process(block.data(), nullptr, state.blockSize);
+                samples.insert(samples.end(), block.begin(), block.end());
+            }
+        };
+        renderPool(voices, reference);
+
+        MemoryBlock data;
+        {
+            MemoryOutputStream stream(data, false);
+            voices.writeState(stream);
+        }
+        MemoryInputStream stream(data, false);
+        bool restoredOk = restored.readState(stream) && restored.isNoteActive(128) && restored.isNoteActive(45);
+
+        renderPool(voices, reference);
+        renderPool(restored, output);
+        double error = restoredOk ? RegressionCheck::compare(output, reference) : std::numeric_limits<double>::infinity();
+
+        bool passed = error == 0.0;
+        if (!passed) ++numFailures;
+        std::printf("%-24s %12.3g %12s %12s %12s  %s\n", "state round trip", error, "-", "-", "-", passed ? "ok" : "FAIL");
+    }
+
+    // Throughput of the best kernel, only comparable with a baseline recorded on the same machine,
+    // so it lives outside the references. A missing baseline is written by the first run
+    if (!settings.baselinePath.empty())
+    {
+        File baselineFile = File::getCurrentWorkingDirectory().getChildFile(String(settings.baselinePath));
+        double throughput = RegressionCheck::measureThroughput(cases, settings.blockSize, 3);
+        if (settings.record || !baselineFile.existsAsFile()) baselineFile.replaceWithText(String(throughput, 0));
+
+        double baseline = baselineFile.loadFileAsString().getDoubleValue();
+        bool fastEnough = baseline > 0.0 && throughput >= baseline * (1.0 - settings.speedTolerance);
+        if (!fastEnough) ++numFailures;
+        std::printf("throughput %.0f samples/s, baseline %.0f: %s\n", throughput, baseline, fastEnough ? "ok" : "FAIL");
+    }
+
+    std::printf("%d failed\n", numFailures);
+    return numFailures > 0 ? 1 : 0;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    Settings settings;
+    vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--fs" && hasValue) settings.Fs = std::atof(argv[++i]);
+        else if (arg == "--block" && hasValue) settings.blockSize = std::atoi(argv[++i]);
+        else if (arg == "--voices" && hasValue) settings.numVoices = std::atoi(argv[++i]);
+        else if (arg == "--workers" && hasValue) settings.numWorkers = std::atoi(argv[++i]);
+        else if (arg == "--seconds" && hasValue) settings.seconds = std::atof(argv[++i]);
+        else if (arg == "--telemetry" && hasValue) settings.telemetryPath = argv[++i];
+        else if (arg == "--simfs" && hasValue) settings.simulationFs = std::atof(argv[++i]);
+        else if (arg == "--theta" && hasValue) settings.params.theta = std::atof(argv[++i]);
+        else if (arg == "--gridscale" && hasValue) settings.params.gridScale = std::atof(argv[++i]);
+        else if (arg == "--tension" && hasValue) settings.params.tension = std::atof(argv[++i]);
+        else if (arg == "--speed" && hasValue) settings.speedTolerance = std::atof(argv[++i]);
+        else if (arg == "--baseline" && hasValue) settings.baselinePath = argv[++i];
+        else if (arg == "--record") settings.record = true;
+        else if (arg == "--quality" && hasValue)
+        {
+            std::string quality = argv[++i];
+            settings.quality = quality == "low" ? Resampler::low : quality == "high" ? Resampler::high : Resampler::medium;
+        }
+        else positional.push_back(arg);
+    }
+
+    if (positional.size() == 3 && positional[0] == "render")
+        return runRender(settings, positional[1], positional[2]);
+
+    if (positional.size() == 1 && positional[0] == "bench")
+        return runBench(settings);
+
+    if (positional.size() == 2 && positional[0] == "check")
+        return runCheck(settings, positional[1]);
+
+    std::fprintf(stderr, "Usage: StiffStringBench render <script> <out.wav> [options]\n"
+                         "       StiffStringBench bench [options]\n"
+                         "       StiffStringBench check <directory> [--record] [--baseline <file>] [--speed <fraction>] [options]\n"
+                         "Options: --fs <Hz> --block <samples> --voices <n> --workers <n> --seconds <s>\n"
+                         "         --telemetry <file.csv> --simfs <Hz> --quality low|medium|high\n"
+                         "         --theta <0..1> --gridscale <0..1> --tension <0..1>\n");
+    return 1;
+}
@@ -0,0 +1,177 @@
+/*
+  ==============================================================================
+
+    RegressionCheck.cpp
+    Created: 4 Jul 2022 3:05:17pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "RegressionCheck.h"
+
+vector<RegressionCheck::Case> RegressionCheck::getCases()
+{
+    // Every excitation on a low and a high string, thin and thick, at two sample rates
+    vector<Case> cases;
+    const char* names[] = { "pluck", "strike", "bow" };
+
+    for (auto excitation : { pluck, strike, bow })
+        for (double f0 : { 110.0, 440.0 })
+            for (double r : { 0.0005, 0.001 })
+                for (double Fs : { 48000.0, 96000.0 })
+                {
+                    std::string name = std::string(names[excitation]) + " " + std::to_string(static_cast<int> (f0))
+                                     + " r" + std::to_string(r * 1000.0).substr(0, 3) + " " + std::to_string(static_cast<int> (Fs / 1000.0)) + "k";
+                    cases.push_back({ name, excitation, f0, r, Fs });
+                }
+
+    return cases;
+}
+
+vector<float> RegressionCheck::render(const Case& c, StencilKernel::Type kernel, bool singlePrecision, double* energyRise)
+{
+    // The energy is read after every sample, so checking it renders one sample per block
+    const int blockSize = energyRise != nullptr ? 1 : 512;
+    if (singlePrecision) return renderString<StiffStringFloat>(c, kernel, blockSize, energyRise);
+    return renderString<StiffString>(c, kernel, blockSize, energyRise);
+}
+
+template <typename StringType>
+vector<float> RegressionCheck::renderString(const Case& c, StencilKernel::Type kernel, int blockSize, double* energyRise)
+{
+    StringParams params;
+    params.f0 = c.f0;
+    params.r = c.r;
+
+    StringType string;
+    string.setFs(c.Fs);
+    string.allocateGrid(StiffString::maxGridSize);
+    string.setKernel(kernel);
+    string.setGrid(params);
+
+    if (c.excitation == bow)
+    {
+        string.queueBow(0, true, 0.2, 0.13f);
+        string.queueBow(static_cast<int> (bowSeconds * c.Fs), false, 0.0, 0.13f);
+    }
+    else
+    {
+        string.exciteSystem(1.0, 0.3f, 15, c.excitation == strike);
+    }
+
+    const int numSamples = static_cast<int> (seconds * c.Fs);
+    const int energyStart = c.excitation == bow ? static_cast<int> (bowSeconds * c.Fs) : 0;
+    vector<float> output(numSamples, 0.0f);
+    double previous = 0.0, peak = 0.0, rise = 0.0;
+
+    for (int start = 0; start < numSamples; start += blockSize)
+    {
+        const int n = jmin(blockSize, numSamples - start);
+        string.renderBlock(output.data() + start, nullptr, n);
+        if (energyRise == nullptr) continue;
+
+        // Largest growth from one sample to the next, relative to the largest energy so far
+        double energy = string.getEnergy();
+        peak = jmax(peak, energy);
+        if (start > energyStart && peak > 0.0) rise = jmax(rise, (energy - previous) / peak);
+        previous = energy;
+    }
+
+    if (energyRise != nullptr) *energyRise = rise;
+    return output;
+}
+
+double RegressionCheck::measureThroughput(const vector<Case>& cases, int blockSize, int repeats)
+{
+    // Samples per second of render time over all cases with the best kernel, the fastest of a few runs
+    double best = 0.0;
+    for (int i = 0; i < repeats; ++i)
+    {
+        int64 numSamples = 0;
+        int64 before = Time::getHighResolutionTicks();
+        for (auto& c : cases)
+        {
+            StringParams params;
+            params.f0 = c.f0;
+            params.r = c.r;
+
+            StiffString string;
+            string.setFs(c.Fs);
+            string.allocateGrid(StiffString::maxGridSize);
+            string.setKernel(StencilKernel::getBestType());
+            string.setGrid(params);
+            if (c.excitation == bow) string.queueBow(0, true, 0.2, 0.13f);
+            else string.exciteSystem(1.0, 0.3f, 15, c.excitation == strike);
+
+            const int length = static_cast<int> (seconds * c.Fs);
+            vector<float> output(blockSize, 0.0f);
+            for (int start = 0; start < length; start += blockSize)
+                string.renderBlock(output.data(), nullptr, jmin(blockSize, length - start));
+            numSamples += length;
+        }
+        double renderSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - before);
+        best = jmax(best, numSamples / renderSeconds);
+    }
+    return best;
+}
+
+double RegressionCheck::compare(const vector<float>& output, const vector<float>& reference)
+{
+    // Largest difference relative to the peak of the reference
+    if (output.size() != reference.size()) return std::numeric_limits<double>::infinity();
+
+    double peak = 0.0, difference = 0.0;
+    for (size_t n = 0; n < reference.size(); ++n)
+    {
+        peak = jmax(peak, static_cast<double> (abs(reference[n])));
+        difference = jmax(difference, static_cast<double> (abs(output[n] - reference[n])));
+    }
+    return peak > 0.0 ? difference / peak : difference;
+}
+
+double RegressionCheck::compareEnvelope(const vector<float>& output, const vector<float>& reference, int frameLength)
+{
+    // Largest difference of the RMS per frame relative to the loudest frame of the reference. The
+    // single precision string drifts away in phase over time but has to keep the same decay
+    if (output.size() != reference.size() || frameLength <= 0) return std::numeric_limits<double>::infinity();
+
+    double peak = 0.0, difference = 0.0;
+    for (size_t start = 0; start + frameLength <= reference.size(); start += frameLength)
+    {
+        double sumOutput = 0.0, sumReference = 0.0;
+        for (size_t n = start; n < start + frameLength; ++n)
+        {
+            sumOutput += static_cast<double> (output[n]) * output[n];
+            sumReference += static_cast<double> (reference[n]) * reference[n];
+        }
+        double rmsReference = sqrt(sumReference / frameLength);
+        peak = jmax(peak, rmsReference);
+        difference = jmax(difference, abs(sqrt(sumOutput / frameLength) - rmsReference));
+    }
+    return peak > 0.0 ? difference / peak : difference;
+}
+
+bool RegressionCheck::writeReference(const File& file, const vector<float>& samples)
+{
+    // Raw little endian 32 bit floats, the references are shared between machines
+    MemoryBlock data;
+    {
+        MemoryOutputStream stream(data, false);
+        for (float sample : samples)
+            stream.writeFloat(sample);
+    }
+    return file.replaceWithData(data.getData(), data.getSize());
+}
+
+bool RegressionCheck::readReference(const File& file, vector<float>& samples)
+{
+    MemoryBlock data;
+    if (!file.loadFileAsData(data) || data.getSize() % sizeof(float) != 0) return false;
+
+    MemoryInputStream stream(data, false);
+    samples.resize(data.getSize() / sizeof(float));
+    for (auto& sample : samples)
+        sample = stream.readFloat();
+    return true;
+}
@@ -0,0 +1,57 @@
+/*
+  ==============================================================================
+
+    RegressionCheck.h
+    Created: 4 Jul 2022 3:05:17pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/StiffString.h"
+
+// Fixed plucks, strikes and bow strokes on single strings, rendered the same way every time so
+// their output can be compared with reference buffers recorded earlier. The references are shared
+// between machines, where contraction into fused multiply-adds outside the stencil kernels and the
+// exp of the friction law round differently, so the scalar kernel only has to stay close to them.
+// On one machine every stencil kernel has to match the scalar kernel exactly, the single precision
+// string stays close in its envelope, and the discrete energy may not grow while nothing drives
+// the string
+class RegressionCheck
+{
+
+public:
+    enum Excitation { pluck, strike, bow };
+
+    struct Case
+    {
+        std::string name;
+        Excitation excitation;
+        double f0;
+        double r;
+        double Fs;
+    };
+
+    static vector<Case> getCases();
+    static vector<float> render(const Case& c, StencilKernel::Type kernel, bool singlePrecision, double* energyRise = nullptr);
+    static double measureThroughput(const vector<Case>& cases, int blockSize, int repeats);
+    static double compare(const vector<float>& output, const vector<float>& reference);
+    static double compareEnvelope(const vector<float>& output, const vector<float>& reference, int frameLength);
+
+    static bool writeReference(const File& file, const vector<float>& samples);
+    static bool readReference(const File& file, vector<float>& samples);
+
+    static constexpr double seconds = 0.1;              // length of every case, short to keep the references small
+    static constexpr double bowSeconds = 0.06;          // the bow lets go here, the energy is checked after it
+    static constexpr double doubleTolerance = 1e-6;     // difference relative to the reference peak, FMA builds stay below 1e-8
+    static constexpr double floatTolerance = 1e-2;      // on the envelope, single precision drifts in phase
+    static constexpr double frameSeconds = 0.01;        // envelope frames
+    static constexpr double energyTolerance = 1e-10;    // energy rise per sample relative to the peak energy
+
+private:
+    template <typename StringType>
+    static vector<float> renderString(const Case& c, StencilKernel::Type kernel, int blockSize, double* energyRise);
+};
@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    SchemeValidation.cpp
+    Created: 28 Mar 2022 10:15:52am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "SchemeValidation.h"
+
+SchemeValidation::Report SchemeValidation::compareFloatToDouble(const StringParams& params, double Fs, double seconds, int numPartials)
+{
+    const int blockSize = 512;
+    const int numBlocks = static_cast<int> (seconds * Fs / blockSize);
+
+    StiffString reference;
+    StiffStringFloat test;
+    int maxN = StiffString::maxGridSize;
+
+    reference.setFs(Fs);
+    reference.allocateGrid(maxN);
+    reference.setGrid(params);
+    reference.exciteSystem(1.0, 0.3, 15, false);
+
+    test.setFs(Fs);
+    test.allocateGrid(maxN);
+    test.setGrid(params);
+    test.exciteSystem(1.0, 0.3, 15, false);
+
+    vector<float> outReference(numBlocks * blockSize, 0.0f), outTest(numBlocks * blockSize, 0.0f);
+    vector<double> energyReference(numBlocks, 0.0), energyTest(numBlocks, 0.0);
+
+    Report report;
+    double initialEnergy = reference.getEnergy();
+
+    for (int b = 0; b < numBlocks; ++b)
+    {
+        reference.renderBlock(&outReference[b * blockSize], nullptr, blockSize);
+        test.renderBlock(&outTest[b * blockSize], nullptr, blockSize);
+
+        energyReference[b] = reference.getEnergy();
+        energyTest[b] = test.getEnergy();
+        report.energyDrift = jmax(report.energyDrift, abs(energyTest[b] - energyReference[b]) / initialEnergy);
+    }
+
+    // Partials of the continuous stiff string: f_n = n * f0 * sqrt(1 + B * n^2)
+    double f0 = params.f0;
+    double L = params.L;
+    double r = params.r;
+    double kappaSq = params.E * r * r * 0.25 / params.rho;
+    double c = f0 * 2.0 * L;
+    double B = kappaSq * double_Pi * double_Pi / (c * c * L * L);
+
+    for (int n = 1; n <= numPartials; ++n)
+    {
+        double expected = n * f0 * sqrt(1.0 + B * n * n);
+        if (expected > 0.45 * Fs) break;
+
+        double freqReference = findPartial(outReference, Fs, expected);
+        double freqTest = findPartial(outTest, Fs, expected);
+        report.frequencyDrift = jmax(report.frequencyDrift, abs(1200.0 * log2(freqTest / freqReference)));
+    }
+
+    report.t60Reference = calculateT60(energyReference, blockSize / Fs);
+    report.t60Test = calculateT60(energyTest, blockSize / Fs);
+    report.decayDrift = abs(report.t60Test - report.t60Reference) / report.t60Reference;
+
+    return report;
+}
+
+double SchemeValidation::findPartial(vector<float>& signal, double Fs, double expectedFreq)
+{
+    // Scan +/- 3 % around the expected frequency with a Hann windowed DFT of the first second
+    // and refine the peak with parabolic interpolation
+    const int length = jmin(static_cast<int> (signal.size()), static_cast<int> (Fs));
+    const int numSteps = 200;
+    const double lowest = expectedFreq * 0.97;
+    const double step = expectedFreq * 0.06 / numSteps;
+
+    vector<double> magnitude(numSteps + 1, 0.0);
+    for (int i = 0; i <= numSteps; ++i)
+    {
+        double omega = 2.0 * double_Pi * (lowest + i * step) / Fs;
+        double re = 0.0, im = 0.0;
+        for (int n = 0; n < length; ++n)
+        {
+            double window = 0.5 * (1.0 - cos(2.0 * double_Pi * n / length));
+            re += window * signal[n] * cos(omega * n);
+            im -= window * signal[n] * sin(omega * n);
+        }
+        magnitude[i] = sqrt(re * re + im * im);
+    }
+
+    int peak = static_cast<int> (max_element(magnitude.begin(), magnitude.end()) - magnitude.begin());
+    double offset = 0.0;
+    if (peak > 0 && peak < numSteps)
+    {
+        double denominator = magnitude[peak - 1] - 2.0 * magnitude[peak] + magnitude[peak + 1];
+        if (denominator != 0.0) offset = 0.5 * (magnitude[peak - 1] - magnitude[peak + 1]) / denominator;
+    }
+
+    return lowest + (peak + offset) * step;
+}
+
+double SchemeValidation::calculateT60(vector<double>& energy, double blockSeconds)
+{
+    // Least squares fit of the log energy after the attack, energy decays with exp(-2 * sigma * t)
+    int start = static_cast<int> (energy.size()) / 10;
+    double sumT = 0.0, sumE = 0.0, sumTT = 0.0, sumTE = 0.0;
+    int count = 0;
+
+    for (int b = start; b < static_cast<int> (energy.size()); ++b)
+    {
+        if (energy[b] <= 0.0) continue;
+        double t = b * blockSeconds;
+        double e = log(energy[b]);
+        sumT += t; sumE += e; sumTT += t * t; sumTE += t * e;
+        ++count;
+    }
+
+    double slope = (count * sumTE - sumT * sumE) / (count * sumTT - sumT * sumT);
+    double sigma = -0.5 * slope;
+
+    return 3.0 * log(10.0) / sigma;
+}
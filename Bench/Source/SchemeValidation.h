@@ -0,0 +1,36 @@
+/*
+  ==============================================================================
+
+    SchemeValidation.h
+    Created: 28 Mar 2022 10:15:52am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/StiffString.h"
+
+// Renders the same pluck with the single and double precision scheme and measures how far
+// the single precision string drifts away from the double precision reference
+class SchemeValidation
+{
+
+public:
+    struct Report
+    {
+        double energyDrift = 0.0;       // largest energy difference relative to the initial energy
+        double frequencyDrift = 0.0;    // largest partial frequency difference in cents
+        double decayDrift = 0.0;        // relative difference of the T60 decay times
+        double t60Reference = 0.0;      // decay time of the double precision string in s
+        double t60Test = 0.0;           // decay time of the single precision string in s
+    };
+
+    static Report compareFloatToDouble(const StringParams& params, double Fs, double seconds, int numPartials);
+
+private:
+    static double findPartial(vector<float>& signal, double Fs, double expectedFreq);
+    static double calculateT60(vector<double>& energy, double blockSeconds);
+};
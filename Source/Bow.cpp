@@ -16,8 +16,9 @@ Bow::Bow()
     vb = 0.0;             // Bow velocity
     xb = 0.0;             // Bow position
     a = 100;              // frcition model scaler
-    BM = sqrt(2.0 * a) * exp(0.5);  // Bow model
-    maxIter = 100;      // Newton-Raphson  max number of iteration
+    friction.setLaw(FrictionModel::exponential, a);   // Bow model
+    vRel = 0.0;           // relative velocity, the solver starts from the previous sample
+    maxIter = 20;       // Newton-Raphson  max number of iteration
     eps = 1e-7;         // Newton-Raphson threshold
 }
 Bow::~Bow()
@@ -25,71 +26,231 @@ Bow::~Bow()
 
 }
 
-void Bow::setBowParams(NamedValueSet& parameters)
+void Bow::setBowParams(const GridCoefficients& grid)
 {
-    rho = *parameters.getVarPointer("rho");
-    r = *parameters.getVarPointer("r");
+    rho = grid.rho;
+    r = grid.r;
     A = double_Pi * r * r;
     Fb = fb / (rho * A);
 
-    sig0 = *parameters.getVarPointer("sig0");
-    sig1 = *parameters.getVarPointer("sig1");
-    k = *parameters.getVarPointer("k");
+    sig0 = grid.sig0;
+    sig1 = grid.sig1;
+    k = grid.k;
     Fs = 1.0 / k; 
-    h = *parameters.getVarPointer("h");
-    kappaSq = *parameters.getVarPointer("kappaSq");
-    cSq = *parameters.getVarPointer("cSq");
-    N = *parameters.getVarPointer("N");
-
-    // Calculate intermediate grid values
-    GI0_0 = (-2.0 / (k * k) + 2.0 * cSq / (h * h) + 6.0 * kappaSq / (h * h * h * h) + 4.0 * sig1 / (k * h * h));
-    GI0_1 = (-cSq / (h * h) - 4.0 * kappaSq / (h * h * h * h) - 2.0 * sig1 / (k * h * h));
-    GI0_2 = (kappaSq / (h * h * h * h));
-    GI1_0 = (2.0 / (k * k) - 4.0 * sig1 / (k * h * h));
-    GI1_1 = (2.0 * sig1 / (k * h * h));
+    h = grid.h;
+    kappaSq = grid.kappaSq;
+    cSq = grid.c * grid.c;
+    N = grid.N;
+
+    // Intermediate grid values are calculated with the grid
+    GI0_0 = grid.GI0_0;
+    GI0_1 = grid.GI0_1;
+    GI0_2 = grid.GI0_2;
+    GI1_0 = grid.GI1_0;
+    GI1_1 = grid.GI1_1;
+
+    calculateKernels();
 }
 
-void Bow::setExcitation(std::vector<double*>& u, float bowPosition, double bowVelocity)
+void Bow::calculateKernels()
 {
-    xb = floor(bowPosition * N); 
-    if (xb > N - 2) xb = N - 2;
-    if (xb  < 2) xb = 2;
+    // The intermediate stencil applied to the Lagrange weights of every phase
+    const double GI0[3] = { GI0_0, GI0_1, GI0_2 };
+    const double GI1[2] = { GI1_0, GI1_1 };
+
+    for (int p = 0; p <= numPhases; ++p)
+    {
+        SpreadKernel& spread = kernels[p];
+        Spreading::lagrangeWeights(static_cast<double> (p) / numPhases, spread.w);
+
+        spread.wSq = 0.0;
+        for (int o = 0; o < 8; ++o) spread.b1[o] = 0.0;
+        for (int o = 0; o < 6; ++o) spread.b2[o] = 0.0;
+
+        for (int j = 0; j < 4; ++j)
+        {
+            // Weight j sits at point j - 1
+            spread.wSq += spread.w[j] * spread.w[j];
+            for (int d = -2; d <= 2; ++d)
+                spread.b1[j + d + 2] += spread.w[j] * GI0[abs(d)];
+            for (int d = -1; d <= 1; ++d)
+                spread.b2[j + d + 1] += spread.w[j] * GI1[abs(d)];
+        }
+    }
+    position = -1.0;
+}
+
+void Bow::setPosition(double x)
+{
+    // Blend the two nearest phases, so a moving bow changes its kernel continuously
+    position = x;
+    xb = static_cast<int> (x);
+    double p = (x - xb) * numPhases;
+    int i = jmin(static_cast<int> (p), numPhases - 1);
+    double t = p - i;
+
+    const SpreadKernel& a = kernels[i];
+    const SpreadKernel& b = kernels[i + 1];
+    for (int o = 0; o < 4; ++o) kernel.w[o] = a.w[o] + t * (b.w[o] - a.w[o]);
+    for (int o = 0; o < 8; ++o) kernel.b1[o] = a.b1[o] + t * (b.b1[o] - a.b1[o]);
+    for (int o = 0; o < 6; ++o) kernel.b2[o] = a.b2[o] + t * (b.b2[o] - a.b2[o]);
+    kernel.wSq = a.wSq + t * (b.wSq - a.wSq);
+    forceGain = kernel.wSq;
+}
+
+void Bow::setFriction(FrictionModel::Law law, double a)
+{
+    this->a = a;
+    friction.setLaw(law, a);
+}
+
+template <typename FloatType>
+void Bow::setExcitation(FloatType* u0, const FloatType* u1, const FloatType* u2, int stride, float bowPosition, double bowVelocity)
+{
+    // The kernel reaches three points to the left and four to the right, the guard points included
+    if (N < minGridSize) return;
+    double x = jlimit(2.0, N - 3.0, static_cast<double> (bowPosition) * N);
+    if (x != position) setPosition(x);
 
     vb = bowVelocity;
-    // vb = 0.2 * sin(12 * double_Pi * t / Fs);
 
-    double b = vb * (2.0 / k + sig0 * 2.0) + GI0_0 * u[1][xb] + GI0_1 * u[1][xb + 1] + GI0_1 * u[1][xb - 1] +
-        GI0_2 * u[1][xb + 2] + GI0_2 * u[1][xb - 2] +
-        GI1_0 * u[2][xb] + GI1_1 * u[2][xb + 1] + GI1_1 * u[2][xb - 1];
+    // Grid points are stride apart, strings in a StringBank are interleaved with other strings
+    const FloatType* v1 = u1 + (xb - 3) * stride;
+    const FloatType* v2 = u2 + (xb - 2) * stride;
+    double b = vb * (2.0 / k + sig0 * 2.0);
+    for (int o = 0; o < 8; ++o) b += kernel.b1[o] * v1[o * stride];
+    for (int o = 0; o < 6; ++o) b += kernel.b2[o] * v2[o * stride];
 
     // Find relative velocity between the bow and string:
     vRel = NewtonRaphson(maxIter, eps, b);
 
     // Apply excitation
-    double excitation = (k * k / (rho * A * h * (1.0 + sig0 * k))) * fb * sqrt(2.0 * a) * vRel * exp(-a * vRel * vRel + 0.5);
-    u[0][xb] -= excitation; // add bow excitation to the grid point
+    double phi, dphi;
+    friction.evaluate(vRel, phi, dphi);
+    double excitation = (k * k / (rho * A * h * (1.0 + sig0 * k))) * fb * phi;
+    FloatType* v0 = u0 + (xb - 1) * stride;
+    for (int j = 0; j < 4; ++j)
+        v0[j * stride] -= static_cast<FloatType> (excitation * kernel.w[j]);    // spread the bow force
+    displacement = excitation;
     t++; 
 }
 
+// The bow is always solved in double precision, also for single precision strings
+template void Bow::setExcitation<float>(float*, const float*, const float*, int, float, double);
+template void Bow::setExcitation<double>(double*, const double*, const double*, int, float, double);
+
+template <typename FloatType>
+void Bow::setExcitation(FloatType* u0, const FloatType* u2, ImplicitScheme& scheme, float bowPosition, double bowVelocity)
+{
+    // u0 holds the update without the bow. Through T0 the bow force reaches every grid point,
+    // so its response is solved once per bow position and scaled by the friction every sample
+    if (N < minGridSize) return;
+    double x = jlimit(2.0, N - 3.0, static_cast<double> (bowPosition) * N);
+    if (x != position)
+    {
+        setPosition(x);
+        forceGain = (1.0 + sig0 * k) * scheme.calculateResponse(xb - 1, kernel.w, 4);
+    }
+
+    vb = bowVelocity;
+
+    // Velocity of the string at the bow without the bow force
+    const double C = 2.0 / k + 2.0 * sig0;
+    double v = 0.0;
+    for (int j = 0; j < 4; ++j)
+        v += kernel.w[j] * (u0[xb - 1 + j] - u2[xb - 1 + j]);
+    double b = C * (vb - v / (2.0 * k));
+
+    // Find relative velocity between the bow and string:
+    vRel = NewtonRaphson(maxIter, eps, b);
+
+    // Apply excitation
+    double phi, dphi;
+    friction.evaluate(vRel, phi, dphi);
+    double excitation = (k * k / (rho * A * h)) * fb * phi;
+    const double* q = scheme.getResponse();
+    for (int l = 1; l < N; ++l)
+        u0[l] -= static_cast<FloatType> (excitation * q[l]);
+    t++;
+}
+template void Bow::setExcitation<float>(float*, const float*, ImplicitScheme&, float, double);
+template void Bow::setExcitation<double>(double*, const double*, ImplicitScheme&, float, double);
+
+template <typename FloatType>
+void Bow::setExcitation(FloatType* u0, const FloatType* u2, float bowPosition, double bowVelocity)
+{
+    // u0 holds the explicit update without the bow, after more than the stencil moved it
+    if (N < minGridSize) return;
+    double x = jlimit(2.0, N - 3.0, static_cast<double> (bowPosition) * N);
+    if (x != position) setPosition(x);
+
+    vb = bowVelocity;
+
+    // Velocity of the string at the bow without the bow force
+    const double C = 2.0 / k + 2.0 * sig0;
+    double v = 0.0;
+    for (int j = 0; j < 4; ++j)
+        v += kernel.w[j] * (u0[xb - 1 + j] - u2[xb - 1 + j]);
+    double b = C * (vb - v / (2.0 * k));
+
+    // Find relative velocity between the bow and string:
+    vRel = NewtonRaphson(maxIter, eps, b);
+
+    // Apply excitation
+    double phi, dphi;
+    friction.evaluate(vRel, phi, dphi);
+    double excitation = (k * k / (rho * A * h * (1.0 + sig0 * k))) * fb * phi;
+    for (int j = 0; j < 4; ++j)
+        u0[xb - 1 + j] -= static_cast<FloatType> (excitation * kernel.w[j]);
+    displacement = excitation;
+    t++;
+}
+template void Bow::setExcitation<float>(float*, const float*, float, double);
+template void Bow::setExcitation<double>(double*, const double*, float, double);
+
 double Bow::NewtonRaphson(int maxIterations, double threshold, double b)
 {
-    double vRelPrev = 0.0; 
-    double vRel = 0.0; 
+    // Solves g(vRel) = C * vRel + F * phi(vRel) + b = 0. The friction term is bounded by
+    // F * max |phi|, which brackets the root, so a Newton step that leaves the bracket
+    // is replaced by bisection and the solve always ends within maxIterations
+    const double C = 2.0 / k + 2.0 * sig0;
+    const double F = (forceGain / h) * Fb;              // the force is spread by w and read back by w
+    const double maxFriction = F * friction.getMaxFriction();
+    double lo = (-b - maxFriction) / C;
+    double hi = (-b + maxFriction) / C;
+
+    // Warm start from the previous sample
+    double v = jlimit(lo, hi, vRel);
+    int i = 0;
 
-    for (int i = 0; i < maxIterations; i++)
+    while (i < maxIterations)
     {
-        double mu = sqrt(2.0 * a) * vRelPrev * exp(-a * vRelPrev * vRelPrev + 0.5);
-        double g = g = vRelPrev * 2 / k + 2 * sig0 * vRelPrev + (1 / h) * Fb * BM * vRelPrev * exp(-a * vRelPrev * vRelPrev) + b;
-        double dg_dvRel = 2 / k + 2 * sig0 + (1 / h) * Fb * BM * (1 - 2 * a * vRelPrev * vRelPrev) * exp(-a * vRelPrev * vRelPrev);
-       
-        vRel = vRelPrev - (g / dg_dvRel);
+        ++i;
+        double phi, dphi;
+        friction.evaluate(v, phi, dphi);
+        double g = C * v + F * phi + b;
+        double dg_dvRel = C + F * dphi;
+
+        // Keep the root inside the bracket
+        if (g < 0.0) lo = v;
+        else hi = v;
 
-        if (std::abs(vRel - vRelPrev) < eps)
+        double vNext = v - g / dg_dvRel;
+        if (!(vNext >= lo && vNext <= hi))
         {
-            break; 
+            vNext = 0.5 * (lo + hi);
+            ++stats.numBisections;
         }
-        vRelPrev = vRel;
+
+        bool converged = std::abs(vNext - v) < threshold;
+        v = vNext;
+        if (converged) break;
     }
-    
-    return vRel; 
+
+    stats.lastIterations = i;
+    stats.maxIterations = jmax(stats.maxIterations, i);
+    stats.totalIterations += i;
+    ++stats.numSolves;
+
+    return v; 
 }
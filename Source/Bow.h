@@ -9,27 +9,78 @@
 */
 #include <JuceHeader.h>
 #include <vector>
+#include "CoefficientCache.h"
+#include "FrictionModel.h"
+#include "Spreading.h"
+#include "ImplicitScheme.h"
 
 class Bow
 {
 
 public:
+    struct SolverStats
+    {
+        int lastIterations = 0;         // iterations of the last solve
+        int maxIterations = 0;          // most iterations of any solve since the last reset
+        int64 totalIterations = 0;
+        int64 numSolves = 0;
+        int64 numBisections = 0;        // Newton steps that left the bracket and were replaced
+    };
+
     Bow();      // Constructor
     ~Bow();     // Destructor
     
-    void setBowParams(NamedValueSet& parameters);
-    void setExcitation(std::vector<double*>& u, float bowPosition, double bowVelocity);
+    void setBowParams(const GridCoefficients& grid);
+    template <typename FloatType>
+    void setExcitation(FloatType* u0, const FloatType* u1, const FloatType* u2, int stride, float bowPosition, double bowVelocity);
+    template <typename FloatType>
+    void setExcitation(FloatType* u0, const FloatType* u2, ImplicitScheme& scheme, float bowPosition, double bowVelocity);
+    template <typename FloatType>
+    void setExcitation(FloatType* u0, const FloatType* u2, float bowPosition, double bowVelocity);
     double NewtonRaphson(int maxIterations, double threshold, double b);
+    void setFriction(FrictionModel::Law law, double a);
+    void setFrictionMode(FrictionModel::Mode mode) { friction.setMode(mode); };
+    const FrictionModel& getFriction() const { return friction; };
+    const SolverStats& getSolverStats() const { return stats; };
+    void resetSolverStats() { stats = SolverStats(); };
+    int getSpreadStart() const { return xb - 1; };                // first of the four points the last excitation moved
+    const double* getSpreadWeights() const { return kernel.w; };
+    double getSpreadDisplacement() const { return displacement; }; // the last excitation moved the points by -displacement * w
+    double getRelativeVelocity() const { return vRel; };          // where the next solve starts, kept with a saved state
+    void setRelativeVelocity(double vRel) { this->vRel = vRel; };
 
     double vb; 
+    static const int numPhases = 64;                    // fractional bow positions with a precomputed kernel
+    static const int minGridSize = 5;                   // smaller grids have no room for the kernel, the bow is off
+
 private:
-    double fb, Fb, vRel, a, eps, BM;                    // Bow parameters
-    int xb;                                             // Bow position
+    // Cubic Lagrange interpolation and spreading at a fractional position, with the
+    // intermediate stencil folded in, so b is one pass over the points around the bow
+    struct SpreadKernel
+    {
+        double w[4];                                    // points -1 .. 2 around the bow
+        double b1[8];                                   // u1 at points -3 .. 4
+        double b2[6];                                   // u2 at points -2 .. 3
+        double wSq;                                     // sum of w squared, scales the bow force in the solver
+    };
+
+    void calculateKernels();
+    void setPosition(double x);
+
+    double fb, Fb, vRel, a, eps;                        // Bow parameters
+    FrictionModel friction;
+    int xb;                                             // grid point left of the bow position
+    double position = -1.0;                             // position of the current kernel in grid points
+    SpreadKernel kernels[numPhases + 1];                // per fraction, calculated with the grid
+    SpreadKernel kernel;                                // at the current position
+    double forceGain = 1.0;                             // spread force read back at the bow, sum of w squared when explicit
+    double displacement = 0.0;                          // of the last explicit excitation
     double sig0, sig1, k, h, rho, r, A, kappaSq, cSq;   // Grid parameters
     double GI0_0, GI0_1, GI0_2, GI1_0, GI1_1;           // Intermediate grid values
     double Fs; 
     int t = 0; 
     int maxIter, N;
+    SolverStats stats;
 
 };
 #pragma once
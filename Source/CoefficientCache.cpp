@@ -0,0 +1,196 @@
+/*
+  ==============================================================================
+
+    CoefficientCache.cpp
+    Created: 11 Apr 2022 4:02:37pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "CoefficientCache.h"
+
+void GridCoefficients::setMaterial(const StringParams& params)
+{
+    f0 = params.f0;
+    L = params.L;
+    rho = params.rho;
+    r = params.r;
+    E = params.E;
+    sig0 = params.sig0;
+    sig1 = params.sig1;
+    theta = jlimit(0.0, 1.0, params.theta);
+    gridScale = jlimit(0.01, 1.0, params.gridScale);
+    tension = jlimit(0.0, 1.0, params.tension);
+}
+
+int GridCoefficients::calculateGridSize(double Fs, double f0, double L, double kappaSq, double sig1)
+{
+    double k = 1.0 / Fs;
+    double c = f0 * 2.0 * L;
+    double stabTmp = c * c * k * k + 4.0 * sig1 * k;
+    double h = sqrt(0.5 * (stabTmp + sqrt((stabTmp * stabTmp) + 16.0 * kappaSq * k * k)));
+    return floor(L / h);
+}
+
+void GridCoefficients::calculateGrid(int maxN)
+{
+    calculateDerived();
+
+    // Create Grid:
+    N = calculateGridSize(Fs, f0, L, kappaSq, sig1);
+
+    // The implicit scheme is at least as stable as the explicit one on the same grid, so any fraction of it works
+    if (isImplicit()) N = jmax(1, roundToInt(N * gridScale));
+    if (N > maxN) N = maxN;                     // a coarser grid than the stability limit is still stable
+    h = L / N;
+
+    calculateCoefficients();
+}
+
+void GridCoefficients::calculateDerived()
+{
+    k = 1.0 / Fs;
+    A = r * r * double_Pi;
+    I = r * r * r * r * double_Pi * 0.25;
+    c = f0 * 2.0 * L;
+    kappaSq = E * I / (rho * A);
+}
+
+bool GridCoefficients::hasSameGrid(const GridCoefficients& other) const
+{
+    // Same points at the same places and the same kind of scheme, so a state carries over as it is
+    return N == other.N && L == other.L && Fs == other.Fs
+        && isImplicit() == other.isImplicit() && isNonlinear() == other.isNonlinear();
+}
+
+bool GridCoefficients::hasSameMaterial(const GridCoefficients& other) const
+{
+    // Every parameter but the pitch
+    return Fs == other.Fs && L == other.L && rho == other.rho && r == other.r && E == other.E && sig0 == other.sig0
+        && sig1 == other.sig1 && theta == other.theta && gridScale == other.gridScale && tension == other.tension;
+}
+
+GridCoefficients GridCoefficients::interpolate(const GridCoefficients& from, const GridCoefficients& to, double t)
+{
+    // The parameters are interpolated and the coefficients calculated from them on the grid both share,
+    // canInterpolate checks that every step in between is stable on it
+    jassert(canInterpolate(from, to));
+    auto mix = [t](double a, double b) { return a + t * (b - a); };
+
+    GridCoefficients grid = to;
+    grid.f0 = mix(from.f0, to.f0);
+    grid.rho = mix(from.rho, to.rho);
+    grid.r = mix(from.r, to.r);
+    grid.E = mix(from.E, to.E);
+    grid.sig0 = mix(from.sig0, to.sig0);
+    grid.sig1 = mix(from.sig1, to.sig1);
+    grid.theta = mix(from.theta, to.theta);
+    grid.tension = mix(from.tension, to.tension);
+
+    grid.calculateDerived();
+    grid.calculateCoefficients();
+    return grid;
+}
+
+bool GridCoefficients::canInterpolate(const GridCoefficients& from, const GridCoefficients& to)
+{
+    // The stability limit grows with f0, kappa^2 and sig1. f0 and sig1 are mixed linearly and
+    // kappa^2 = E r^2 / (4 rho) with r^2 / rho convex, so during the glide none of them exceeds
+    // its largest end. Stable ends alone don't prove this when one has the higher f0 and the other
+    // the stiffer string, so the grid must hold the largest of each at once
+    if (!from.hasSameGrid(to)) return false;
+
+    double f0 = jmax(from.f0, to.f0);
+    double kappaSq = from.E == to.E ? jmax(from.kappaSq, to.kappaSq)
+                                    : jmax(from.E, to.E) * jmax(from.kappaSq / from.E, to.kappaSq / to.E);
+    double sig1 = jmax(from.sig1, to.sig1);
+    return to.N <= calculateGridSize(to.Fs, f0, to.L, kappaSq, sig1);
+}
+
+void GridCoefficients::calculateCoefficients()
+{
+    // Calculate Stencil factors:
+    lambdaSq = k * k * c * c / (h * h);
+    S0 = sig0 * k;                              // freq ind damping factor
+    S1 = 2 * k * sig1 / (h * h);                // freq dep damping factor
+    K = -kappaSq * k * k / (h * h * h * h);     // stiffness factor
+    D = 1 / (1 + S0);                           // fraction due to freq. indep. damping term
+
+    G0_0 = (2 -2 * lambdaSq + 6 * K - 2 * S1) * D;      // u_l^ n
+    G0_1 = (lambdaSq - 4 * K + S1) * D;                 // u_l -/+1 ^ n
+    G0_2 = K * D;                                       // u_l -/+2 ^ n
+    G1_0 = (-1 + S0 + 2 * S1) * D;                      // u_l^ n - 1
+    G1_1 = -S1 * D;                                     // u_l -/+1 ^ n - 1
+
+    // Calculate intermediate grid values for the bow
+    double cSq = c * c;
+    GI0_0 = (-2.0 / (k * k) + 2.0 * cSq / (h * h) + 6.0 * kappaSq / (h * h * h * h) + 4.0 * sig1 / (k * h * h));
+    GI0_1 = (-cSq / (h * h) - 4.0 * kappaSq / (h * h * h * h) - 2.0 * sig1 / (k * h * h));
+    GI0_2 = (kappaSq / (h * h * h * h));
+    GI1_0 = (2.0 / (k * k) - 4.0 * sig1 / (k * h * h));
+    GI1_1 = (2.0 * sig1 / (k * h * h));
+
+    // Implicit scheme: the tension and stiffness terms are averaged over theta u^n and (1 - theta) / 2 (u^n+1 + u^n-1),
+    // and the frequency dependent damping is centered in time. Solving for u^n+1 + u^n-1 leaves a right hand side
+    // with the shape of the explicit stencil. T0 is positive definite and is solved every sample
+    double T_0 = -2 * lambdaSq + 6 * K;                 // k^2 times the tension and stiffness operator
+    double T_1 = lambdaSq - 4 * K;
+    double T_2 = K;
+    double mu = 0.5 * (1.0 - theta);
+
+    T0_0 = 1 + S0 - mu * T_0 + S1;                      // u_l^ n + 1 + u_l^ n - 1
+    T0_1 = -mu * T_1 - 0.5 * S1;                        // u_l -/+1 ^ n + 1 + u_l -/+1 ^ n - 1
+    T0_2 = -mu * T_2;                                   // u_l -/+2 ^ n + 1 + u_l -/+2 ^ n - 1
+    T1_0 = 2 + theta * T_0;                             // u_l^ n
+    T1_1 = theta * T_1;                                 // u_l -/+1 ^ n
+    T1_2 = theta * T_2;                                 // u_l -/+2 ^ n
+    T2_0 = 2 * S0 + 2 * S1;                             // u_l^ n - 1
+    T2_1 = -S1;                                         // u_l -/+1 ^ n - 1
+
+    // Tension modulation: the potential tension * E A / (8 L) s^2, with s = h sum (dx+ u)^2, is written as psi^2 / 2
+    // with psi = psiScale * s. With g_l = u_l-1 - 2 u_l + u_l+1, psi changes by psiGradient * g . du and a force
+    // of -mu spread along that gradient moves the grid by -psiGain * mu * g
+    psiScale = sqrt(tension * E * A / (4.0 * L));
+    psiGradient = -2.0 * psiScale / h;
+    psiGain = psiGradient * k * k / (rho * A * h) * D;
+}
+
+CoefficientCache::CoefficientCache()
+{
+
+}
+
+CoefficientCache::~CoefficientCache()
+{
+
+}
+
+void CoefficientCache::build(double Fs, const StringParams& params, int maxN)
+{
+    // Note-ons copy an entry, only a material change rebuilds the table. A recalled preset
+    // or a pitch change with the same material keeps it
+    GridCoefficients previous = material;
+    material.Fs = Fs;
+    material.setMaterial(params);
+    material.calculateGrid(maxN);
+
+    if (isBuilt && maxN == this->maxN && material.hasSameMaterial(previous)) return;
+    this->maxN = maxN;
+    isBuilt = true;
+
+    for (int note = 0; note < numNotes; ++note)
+    {
+        notes[note] = material;
+        notes[note].f0 = MidiMessage::getMidiNoteInHertz(note);
+        notes[note].calculateGrid(maxN);
+    }
+}
+
+GridCoefficients CoefficientCache::getFrequency(double f0) const
+{
+    GridCoefficients coefficients = material;
+    coefficients.f0 = f0;
+    coefficients.calculateGrid(maxN);
+    return coefficients;
+}
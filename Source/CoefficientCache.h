@@ -0,0 +1,64 @@
+/*
+  ==============================================================================
+
+    CoefficientCache.h
+    Created: 11 Apr 2022 4:02:37pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StringParams.h"
+
+// Everything a string and its bow need for one pitch. Plain data, so it is copied on the
+// audio thread without allocation or parameter lookups
+struct GridCoefficients
+{
+    double Fs, k;                                                           // sample rate and time step
+    double f0, L, rho, r, E, sig0, sig1, theta, gridScale, tension;         // parameters
+    double A, I, c, kappaSq, h;                                             // derived grid values
+    int N;                                                                  // grid size
+    double lambdaSq, S0, S1, K, D, G0_0, G0_1, G0_2, G1_0, G1_1;            // Stencil factors
+    double GI0_0, GI0_1, GI0_2, GI1_0, GI1_1;                               // intermediate grid values for the bow
+    double T0_0, T0_1, T0_2, T1_0, T1_1, T1_2, T2_0, T2_1;                  // implicit scheme, T0 (u^n+1 + u^n-1) = T1 u^n + T2 u^n-1
+    double psiScale, psiGradient, psiGain;                                  // tension modulation, see calculateCoefficients
+
+    bool isImplicit() const { return theta < 1.0; };
+    bool isNonlinear() const { return tension > 0.0 && !isImplicit(); };
+
+    void setMaterial(const StringParams& params);
+    void calculateGrid(int maxN);
+    void calculateDerived();
+    void calculateCoefficients();
+    bool hasSameGrid(const GridCoefficients& other) const;
+    bool hasSameMaterial(const GridCoefficients& other) const;
+
+    static int calculateGridSize(double Fs, double f0, double L, double kappaSq, double sig1);
+    static GridCoefficients interpolate(const GridCoefficients& from, const GridCoefficients& to, double t);
+    static bool canInterpolate(const GridCoefficients& from, const GridCoefficients& to);
+};
+
+// Grids for all MIDI notes with the current material, rebuilt when the material changes
+class CoefficientCache
+{
+
+public:
+    CoefficientCache();      // Constructor
+    ~CoefficientCache();     // Destructor
+
+    void build(double Fs, const StringParams& params, int maxN);
+    const GridCoefficients& getNote(int noteNumber) const { return notes[noteNumber]; };
+    GridCoefficients getFrequency(double f0) const;
+    const GridCoefficients& getMaterial() const { return material; };
+
+    static const int numNotes = 128;
+
+private:
+    GridCoefficients material;      // material and sample rate, used for pitches between the notes
+    GridCoefficients notes[numNotes];
+    int maxN = 0;
+    bool isBuilt = false;
+};
@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    FrictionModel.cpp
+    Created: 26 Apr 2022 9:48:51am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "FrictionModel.h"
+
+FrictionModel::FrictionModel()
+{
+    setLaw(exponential, a);
+}
+
+FrictionModel::~FrictionModel()
+{
+
+}
+
+void FrictionModel::setLaw(Law law, double a)
+{
+    // The table only depends on the law and a, the bow force scales phi outside of it
+    this->law = law;
+    this->a = a;
+    BM = sqrt(2.0 * a) * exp(0.5);
+    buildTable();
+}
+
+void FrictionModel::evaluateExact(double v, double& phi, double& dphi) const
+{
+    switch (law)
+    {
+        case hyperbolic:
+        {
+            double e = 0.5 / a;
+            double d = 1.0 / (v * v + e);
+            phi = 2.0 * sqrt(e) * v * d;
+            dphi = 2.0 * sqrt(e) * (e - v * v) * d * d;
+            break;
+        }
+        default:
+        {
+            double e = exp(-a * v * v);
+            phi = BM * v * e;
+            dphi = BM * (1.0 - 2.0 * a * v * v) * e;
+            break;
+        }
+    }
+}
+
+void FrictionModel::buildTable()
+{
+    // Cover the velocities where the curve has shape: up to exp(-20) of the exponential law, and
+    // 10 peak widths of the hyperbolic law, whose 1 / v tail is cheap to evaluate exactly
+    vMax = (law == exponential ? sqrt(20.0 / a) : 10.0 / sqrt(2.0 * a));
+    dv = 2.0 * vMax / (tableSize - 1);
+    scale = 1.0 / dv;
+
+    // Hermite interpolation of phi and its slope at both ends of each interval
+    for (int i = 0; i < tableSize - 1; ++i)
+    {
+        double p0, p1, m0, m1;
+        evaluateExact(-vMax + i * dv, p0, m0);
+        evaluateExact(-vMax + (i + 1) * dv, p1, m1);
+        m0 *= dv;
+        m1 *= dv;
+
+        table[i][0] = p0;
+        table[i][1] = m0;
+        table[i][2] = 3.0 * (p1 - p0) - 2.0 * m0 - m1;
+        table[i][3] = 2.0 * (p0 - p1) + m0 + m1;
+    }
+
+    // Measure the interpolation error between the table points, relative to the peak of the curve
+    // and of its derivative, which is largest at v = 0
+    double phiExact, dphiExact, phi, dphi, dphiMax;
+    evaluateExact(0.0, phiExact, dphiMax);
+
+    Mode previous = mode;
+    mode = tabulated;
+
+    errorBound = 0.0;
+    for (int i = 0; i < tableSize - 1; ++i)
+    {
+        for (int j = 1; j < 4; ++j)
+        {
+            double v = -vMax + (i + 0.25 * j) * dv;
+            evaluateExact(v, phiExact, dphiExact);
+            evaluate(v, phi, dphi);
+            errorBound = jmax(errorBound, std::abs(phi - phiExact), std::abs(dphi - dphiExact) / dphiMax);
+        }
+    }
+
+    mode = previous;
+}
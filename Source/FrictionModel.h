@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    FrictionModel.h
+    Created: 26 Apr 2022 9:48:51am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+
+// Friction characteristic phi(v) of the bow and its derivative, normalised to a peak of 1 at
+// v = 1 / sqrt(2a). Evaluated exactly, or from a table with cubic Hermite interpolation
+class FrictionModel
+{
+
+public:
+    enum Law
+    {
+        exponential,        // sqrt(2a) v exp(-a v^2 + 1/2)
+        hyperbolic          // 2 sqrt(e) v / (v^2 + e), e = 1 / (2a), decays as 1 / v
+    };
+
+    enum Mode
+    {
+        exact,
+        tabulated
+    };
+
+    FrictionModel();      // Constructor
+    ~FrictionModel();     // Destructor
+
+    void setLaw(Law law, double a);
+    void setMode(Mode mode) { this->mode = mode; };
+    Mode getMode() const { return mode; };
+
+    inline void evaluate(double v, double& phi, double& dphi) const
+    {
+        double x = (v + vMax) * scale;
+        if (mode == exact || !(x >= 0.0 && x < tableSize - 1))
+        {
+            evaluateExact(v, phi, dphi);
+            return;
+        }
+
+        // Cubic Hermite between the two neighbouring points in power form, t in [0, 1)
+        int i = static_cast<int> (x);
+        double t = x - i;
+        const double* c = table[i];
+        phi = ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+        dphi = ((3.0 * c[3] * t + 2.0 * c[2]) * t + c[1]) * scale;
+    }
+
+    void evaluateExact(double v, double& phi, double& dphi) const;
+    double getMaxFriction() const { return 1.0; };                     // largest |phi| of every law
+    double getErrorBound() const { return errorBound; };               // largest table error of phi and dphi / max |dphi|
+
+    static const int tableSize = 513;
+
+private:
+    void buildTable();
+
+    Law law = exponential;
+    Mode mode = tabulated;
+    double a = 100.0;               // friction model scaler
+    double BM = 0.0;                // sqrt(2a) * exp(0.5)
+
+    double vMax = 0.0;              // table covers -vMax .. vMax, outside it phi is evaluated exactly
+    double dv = 0.0;
+    double scale = 0.0;             // 1 / dv
+    double table[tableSize - 1][4];                                     // polynomial per interval
+    double errorBound = 0.0;
+};
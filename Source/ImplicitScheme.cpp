@@ -0,0 +1,238 @@
+/*
+  ==============================================================================
+
+    ImplicitScheme.cpp
+    Created: 13 Jun 2022 10:41:26am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "ImplicitScheme.h"
+
+ImplicitScheme::ImplicitScheme()
+{
+
+}
+
+ImplicitScheme::~ImplicitScheme()
+{
+
+}
+
+void ImplicitScheme::allocate(int maxN)
+{
+    // Indexed by grid point, with room for the two zero points past the boundary
+    this->maxN = maxN;
+    l1 = vector<double>(maxN + 3, 0.0);
+    l2 = vector<double>(maxN + 3, 0.0);
+    invD = vector<double>(maxN + 3, 0.0);
+    response = vector<double>(maxN + 4, 0.0);
+    N = 0;
+}
+
+void ImplicitScheme::setCoefficients(const GridCoefficients& grid)
+{
+    // The factorization is kept while T0 stays the same, the right hand side belongs to the stencil kernel
+    jassert(grid.N <= maxN);
+    if (grid.N == N && grid.T0_0 == T0[0] && grid.T0_1 == T0[1] && grid.T0_2 == T0[2]) return;
+
+    N = grid.N;
+    T0[0] = grid.T0_0; T0[1] = grid.T0_1; T0[2] = grid.T0_2;
+    factorize();
+}
+
+void ImplicitScheme::factorize()
+{
+    // T0 has the same entries on every diagonal and the same boundaries on both ends, so the factors
+    // from the bottom mirror the factors from the top. Both halves are eliminated towards the middle
+    // at once and meet in a 4 by 4 system, which gives the solve two independent recurrences.
+    // Short grids are solved from the top down only
+    const int M = N - 1;                                        // unknowns at 1 .. N - 1
+    twist = M >= minTwistedSize ? (M + 1) / 2 : 0;
+    const int size = twist > 0 ? twist : M;
+
+    fill(l1.begin(), l1.end(), 0.0);
+    fill(l2.begin(), l2.end(), 0.0);
+    fill(invD.begin(), invD.end(), 1.0);
+
+    // L D L^T of the leading rows, invD holds D until the end
+    for (int j = 1; j <= size; ++j)
+    {
+        double d = T0[0];
+        if (j >= 3)
+        {
+            l2[j] = T0[2] / invD[j - 2];
+            d -= l2[j] * l2[j] * invD[j - 2];
+        }
+        if (j >= 2)
+        {
+            l1[j] = (T0[1] - l2[j] * l1[j - 1] * invD[j - 2]) / invD[j - 1];
+            d -= l1[j] * l1[j] * invD[j - 1];
+        }
+        invD[j] = d;
+    }
+
+    for (int j = 1; j <= size; ++j)
+        invD[j] = 1.0 / invD[j];
+    invD[0] = 0.0;
+    for (int j = size + 1; j < static_cast<int> (l1.size()); ++j)
+        invD[j] = 0.0;
+
+    if (twist == 0) return;
+
+    // Last two rows and columns of the inverse of each half, the top at points m - 1, m and the bottom at m + 1, m + 2
+    const int m = twist;
+    const int nB = M - m;
+    double GT[2][2] = { { invD[m - 1] + l1[m] * l1[m] * invD[m], -l1[m] * invD[m] },
+                        { -l1[m] * invD[m], invD[m] } };
+    double GB[2][2] = { { invD[nB], -l1[nB] * invD[nB] },
+                        { -l1[nB] * invD[nB], invD[nB - 1] + l1[nB] * l1[nB] * invD[nB] } };
+
+    // Coupling of the top rows m - 1, m with the bottom points m + 1, m + 2, and its transpose
+    const double C[2][2] = { { T0[2], 0.0 }, { T0[1], T0[2] } };
+    for (int i = 0; i < 2; ++i)
+    {
+        for (int j = 0; j < 2; ++j)
+        {
+            P[i][j] = GT[i][0] * C[0][j] + GT[i][1] * C[1][j];
+            Q[i][j] = GB[i][0] * C[j][0] + GB[i][1] * C[j][1];
+        }
+    }
+
+    // R = (I - P Q)^-1
+    double S[2][2];
+    for (int i = 0; i < 2; ++i)
+        for (int j = 0; j < 2; ++j)
+            S[i][j] = (i == j ? 1.0 : 0.0) - (P[i][0] * Q[0][j] + P[i][1] * Q[1][j]);
+
+    double det = S[0][0] * S[1][1] - S[0][1] * S[1][0];
+    R[0][0] = S[1][1] / det;
+    R[0][1] = -S[0][1] / det;
+    R[1][0] = -S[1][0] / det;
+    R[1][1] = S[0][0] / det;
+}
+
+template <typename FloatType>
+void ImplicitScheme::process(FloatType* u0, const FloatType* u2)
+{
+    // u0 holds the right hand side from the stencil kernel, its solve is u^n+1 + u^n-1
+    solve(u0);
+
+    for (int l = 1; l < N; ++l)
+        u0[l] -= u2[l];
+}
+template void ImplicitScheme::process<float>(float*, const float*);
+template void ImplicitScheme::process<double>(double*, const double*);
+
+template <typename FloatType>
+void ImplicitScheme::solve(FloatType* x)
+{
+    // Solves T0 x = b in place, x holds b on the points 1 .. N - 1
+    auto rightHandSide = [x](int l) { return static_cast<double> (x[l]); };
+
+    if (twist > 0) solveTwisted(x, rightHandSide);
+    else solveSequential(x, rightHandSide);
+}
+template void ImplicitScheme::solve<float>(float*);
+template void ImplicitScheme::solve<double>(double*);
+
+template <typename FloatType, typename RightHandSide>
+void ImplicitScheme::solveSequential(FloatType* x, RightHandSide rightHandSide)
+{
+    // The previous two points stay in registers, so each point waits on one multiply and subtract
+    double y1 = 0.0, y2 = 0.0;
+    for (int l = 1; l < N; ++l)
+    {
+        double y = rightHandSide(l) - l2[l] * y2 - l1[l] * y1;
+        x[l] = static_cast<FloatType> (y);
+        y2 = y1;
+        y1 = y;
+    }
+
+    double z1 = 0.0, z2 = 0.0;
+    for (int l = N - 1; l > 0; --l)
+    {
+        double z = x[l] * invD[l] - l2[l + 2] * z2 - l1[l + 1] * z1;
+        x[l] = static_cast<FloatType> (z);
+        z2 = z1;
+        z1 = z;
+    }
+}
+
+template <typename FloatType, typename RightHandSide>
+void ImplicitScheme::solveTwisted(FloatType* x, RightHandSide rightHandSide)
+{
+    // The top half runs down from point 1 to m, the bottom half up from point N - 1 to m + 1.
+    // Bottom point l uses the factors of row N - l
+    const int m = twist;
+    const int nB = N - 1 - m;
+
+    double t1 = 0.0, t2 = 0.0, b1 = 0.0, b2 = 0.0;
+    for (int j = 1; j <= nB; ++j)
+    {
+        double t = rightHandSide(j) - l2[j] * t2 - l1[j] * t1;
+        double b = rightHandSide(N - j) - l2[j] * b2 - l1[j] * b1;
+        x[j] = static_cast<FloatType> (t);
+        x[N - j] = static_cast<FloatType> (b);
+        t2 = t1; t1 = t;
+        b2 = b1; b1 = b;
+    }
+    if (m > nB)
+    {
+        double t = rightHandSide(m) - l2[m] * t2 - l1[m] * t1;
+        x[m] = static_cast<FloatType> (t);
+        t2 = t1; t1 = t;
+    }
+
+    // Each half on its own at the meeting points, then corrected for the coupling between them
+    double gT[2], gB[2];
+    gT[1] = t1 * invD[m];
+    gT[0] = t2 * invD[m - 1] - l1[m] * gT[1];
+    gB[0] = b1 * invD[nB];
+    gB[1] = b2 * invD[nB - 1] - l1[nB] * gB[0];
+
+    double rT[2] = { gT[0] - P[0][0] * gB[0] - P[0][1] * gB[1], gT[1] - P[1][0] * gB[0] - P[1][1] * gB[1] };
+    double sT[2] = { R[0][0] * rT[0] + R[0][1] * rT[1], R[1][0] * rT[0] + R[1][1] * rT[1] };
+    double sB[2] = { gB[0] - Q[0][0] * sT[0] - Q[0][1] * sT[1], gB[1] - Q[1][0] * sT[0] - Q[1][1] * sT[1] };
+
+    x[m - 1] = static_cast<FloatType> (sT[0]);
+    x[m] = static_cast<FloatType> (sT[1]);
+    x[m + 1] = static_cast<FloatType> (sB[0]);
+    x[m + 2] = static_cast<FloatType> (sB[1]);
+
+    // Back substitution outwards from the meeting points, again both halves at once
+    double z1 = sT[0], z2 = sT[1], w1 = sB[1], w2 = sB[0];
+    int j = nB - 2;
+    if (m - 2 > j)
+    {
+        double z = x[m - 2] * invD[m - 2] - l2[m] * z2 - l1[m - 1] * z1;
+        x[m - 2] = static_cast<FloatType> (z);
+        z2 = z1; z1 = z;
+    }
+    for (; j > 0; --j)
+    {
+        double z = x[j] * invD[j] - l2[j + 2] * z2 - l1[j + 1] * z1;
+        double w = x[N - j] * invD[j] - l2[j + 2] * w2 - l1[j + 1] * w1;
+        x[j] = static_cast<FloatType> (z);
+        x[N - j] = static_cast<FloatType> (w);
+        z2 = z1; z1 = z;
+        w2 = w1; w1 = w;
+    }
+}
+
+double ImplicitScheme::calculateResponse(int l, const double* weights, int numWeights)
+{
+    // The displacement a force spread with weights from point l on causes, returns its spread back onto the weights
+    fill(response.begin(), response.end(), 0.0);
+    double* q = response.data() + 1;
+    for (int j = 0; j < numWeights; ++j)
+        if (l + j > 0 && l + j < N) q[l + j] = weights[j];
+
+    solve(q);
+
+    double gain = 0.0;
+    for (int j = 0; j < numWeights; ++j)
+        gain += weights[j] * q[l + j];
+    return gain;
+}
@@ -0,0 +1,56 @@
+/*
+  ==============================================================================
+
+    ImplicitScheme.h
+    Created: 13 Jun 2022 10:41:26am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "CoefficientCache.h"
+
+using namespace std;
+
+// Theta scheme of the stiff string, T0 (u^n+1 + u^n-1) = T1 u^n + T2 u^n-1 with a pentadiagonal T0.
+// The right hand side is the explicit stencil with the factors T1 and T2. T0 is symmetric positive
+// definite and factorized into L D L^T when it changes, so a sample is one banded forward and back
+// substitution, run from both ends of the string at once
+class ImplicitScheme
+{
+
+public:
+    ImplicitScheme();      // Constructor
+    ~ImplicitScheme();     // Destructor
+
+    void allocate(int maxN);
+    void setCoefficients(const GridCoefficients& grid);
+    template <typename FloatType>
+    void process(FloatType* u0, const FloatType* u2);
+    template <typename FloatType>
+    void solve(FloatType* x);
+    double calculateResponse(int l, const double* weights, int numWeights);
+    const double* getResponse() const { return response.data() + 1; };
+
+private:
+    void factorize();
+    template <typename FloatType, typename RightHandSide>
+    void solveSequential(FloatType* x, RightHandSide rightHandSide);
+    template <typename FloatType, typename RightHandSide>
+    void solveTwisted(FloatType* x, RightHandSide rightHandSide);
+
+    static const int minTwistedSize = 8;    // fewer unknowns are solved from the top down
+
+    vector<double> l1, l2;                  // subdiagonals of L, points l - 1 and l - 2
+    vector<double> invD;                    // inverse of D
+    vector<double> response;                // solve of the last spread force, with guard points
+    double T0[3] {};                        // matrix stencil around l
+    double P[2][2], Q[2][2], R[2][2];       // coupling of the two halves at the meeting points
+    int twist = 0;                          // last point of the top half, 0 solves from the top down
+    int N = 0;
+    int maxN = 0;
+};
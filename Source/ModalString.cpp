@@ -0,0 +1,444 @@
+/*
+  ==============================================================================
+
+    ModalString.cpp
+    Created: 17 May 2022 3:05:52pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "ModalString.h"
+
+ModalString::ModalString()
+{
+
+}
+
+ModalString::~ModalString()
+{
+
+}
+
+void ModalString::allocate(int maxModes)
+{
+    this->maxModes = maxModes;
+    qStates = vector<double>(2 * maxModes, 0.0);
+    q1 = &qStates[0];
+    q2 = &qStates[maxModes];
+    c1 = vector<double>(maxModes, 0.0);
+    c2 = vector<double>(maxModes, 0.0);
+    thetas = vector<double>(maxModes, 0.0);
+    wL = vector<double>(maxModes, 0.0);
+    wR = vector<double>(maxModes, 0.0);
+    e = vector<double>(maxModes, 0.0);
+    sines = vector<double>(maxModes, 0.0);
+}
+
+void ModalString::setGrid(const GridCoefficients& grid)
+{
+    this->grid = grid;
+    clearState();
+    numEvents = 0;
+    calculateWavenumbers();
+    calculateModes();
+    if (excitationWindow.width == 0) excitationWindow.calculate(Spreading::Window::defaultWidth);
+}
+
+void ModalString::clearState()
+{
+    fill(qStates.begin(), qStates.end(), 0.0);
+    numActive = 0;
+    energy = 0.0;
+}
+
+void ModalString::writeState(MemoryOutputStream& stream)
+{
+    // Displacements of the active modes at n and n - 1, the rest are silent
+    stream.writeInt(numActive);
+    for (int m = 0; m < numActive; ++m)
+    {
+        stream.writeDouble(q1[m]);
+        stream.writeDouble(q2[m]);
+    }
+}
+
+bool ModalString::readState(MemoryInputStream& stream, double timeScale)
+{
+    // Mode m has the same shape on every grid, so the state fits any grid. Modes past the
+    // current grid are dropped. More modes than the rows hold or a stream too short for them
+    // is rejected and leaves the modes at rest. timeScale is the new time step over the saved one
+    clearState();
+    const int count = stream.readInt();
+    if (count < 0 || count > maxModes || stream.getNumBytesRemaining() < static_cast<int64> (count * 2 * sizeof(double)))
+        return false;
+
+    for (int m = 0; m < count; ++m)
+    {
+        double a = stream.readDouble();
+        double b = stream.readDouble();
+        if (m >= numModes) continue;
+        q1[m] = a;
+        q2[m] = a - timeScale * (a - b);
+    }
+
+    numActive = jlimit(0, numModes, count);
+    updateActiveModes();
+    return true;
+}
+
+void ModalString::retune(const GridCoefficients& grid)
+{
+    // Every mode keeps its displacement and continues at its new frequency
+    this->grid = grid;
+    calculateWavenumbers();
+    calculateModes();
+}
+
+void ModalString::setDamping(double sig0)
+{
+    // The wavenumbers don't depend on the damping
+    grid.sig0 = sig0;
+    grid.calculateCoefficients();
+    calculateModes();
+}
+
+void ModalString::calculateModes()
+{
+    // Every mode turns the stencil of the scheme into a two term recursion q0 = c1 q1 + c2 q2 with
+    // cos(theta) terms, so the modes play the frequencies and decays of the StiffString and a
+    // handover to it keeps the pitch
+    for (int m = 1; m <= numModes; ++m)
+    {
+        double theta = thetas[m - 1];
+        double cos1 = 2.0 * cos(theta);
+        double cos2 = 2.0 * cos(2.0 * theta);
+
+        if (grid.isImplicit())
+        {
+            // T0 (q0 + q2) = T1 q1 + T2 q2
+            double T0 = grid.T0_0 + grid.T0_1 * cos1 + grid.T0_2 * cos2;
+            c1[m - 1] = (grid.T1_0 + grid.T1_1 * cos1 + grid.T1_2 * cos2) / T0;
+            c2[m - 1] = (grid.T2_0 + grid.T2_1 * cos1) / T0 - 1.0;
+        }
+        else
+        {
+            c1[m - 1] = grid.G0_0 + grid.G0_1 * cos1 + grid.G0_2 * cos2;
+            c2[m - 1] = grid.G1_0 + grid.G1_1 * cos1;
+        }
+
+        // Energy per squared amplitude at the frequency the recursion plays
+        double cosine = jlimit(-1.0, 1.0, c1[m - 1] / (2.0 * sqrt(jmax(-c2[m - 1], 1e-300))));
+        double omega = acos(cosine) / grid.k;
+        e[m - 1] = 0.25 * grid.rho * grid.A * grid.L * omega * omega;
+    }
+
+    // Modes that no longer fit on the grid are silenced
+    for (int m = numModes; m < maxModes; ++m)
+        q1[m] = q2[m] = 0.0;
+    numActive = jmin(numActive, numModes);
+}
+
+void ModalString::calculateWavenumbers()
+{
+    N = grid.N;
+    weightsValid = false;
+    numModes = jmin(N - 1, maxModes);
+
+    for (int m = 1; m <= numModes; ++m)
+        thetas[m - 1] = findWavenumber(m);
+}
+
+double ModalString::findWavenumber(int m)
+{
+    // The zero guard points clamp the stiffness term at both ends, so sin(m pi l / N) is not quite
+    // a mode of the scheme. The mode is cos(theta x) or sin(theta x) around the middle of the string
+    // plus cosh(alpha x) or sinh(alpha x), the second root of the stencil, and both vanish at the
+    // boundary and its guard point. theta is found between m pi / N and (m + 1) pi / N
+    const double thetaM = m * double_Pi / N;
+    const double b1 = grid.lambdaSq - 4.0 * grid.K;         // stiffness and tension stencil b0, b1, b2
+    const double b2 = grid.K;
+    if (b2 == 0.0) return thetaM;
+
+    const bool isEven = m % 2 == 0;
+    const double x0 = 0.5 * N;                              // grid point 0 from the middle
+    auto boundary = [&](double theta)
+    {
+        double w = -b1 / b2 - 2.0 * cos(theta);             // z + 1 / z of the decaying root
+        if (w <= 2.0) return 0.0;
+        double alpha = acosh(0.5 * w);
+        if (isEven) return sin(theta * x0) * (cosh(alpha) + sinh(alpha) / tanh(alpha * x0)) - sin(theta * (x0 + 1.0));
+        return cos(theta * x0) * (cosh(alpha) + sinh(alpha) * tanh(alpha * x0)) - cos(theta * (x0 + 1.0));
+    };
+
+    // Regula falsi with the Illinois step
+    double lo = thetaM, hi = jmin(thetaM + double_Pi / N, double_Pi);
+    double fLo = boundary(lo), fHi = boundary(hi);
+    if (fLo == 0.0) return lo;
+    if (fLo * fHi > 0.0) return thetaM;
+
+    int side = 0;
+    for (int i = 0; i < 60 && hi - lo > 1e-15 * hi; ++i)
+    {
+        double theta = (lo * fHi - hi * fLo) / (fHi - fLo);
+        double f = boundary(theta);
+        if (f == 0.0) return theta;
+
+        if (f * fHi > 0.0)
+        {
+            hi = theta;
+            fHi = f;
+            if (side == -1) fLo *= 0.5;
+            side = -1;
+        }
+        else
+        {
+            lo = theta;
+            fLo = f;
+            if (side == 1) fHi *= 0.5;
+            side = 1;
+        }
+    }
+    return 0.5 * (lo + hi);
+}
+
+void ModalString::calculateSines(double theta, int num)
+{
+    // sin(m theta) for m = 1 .. num with the Chebyshev recurrence
+    const double twoCos = 2.0 * cos(theta);
+    double previous = 0.0;
+    double current = sin(theta);
+
+    for (int m = 0; m < num; ++m)
+    {
+        sines[m] = current;
+        double next = twoCos * current - previous;
+        previous = current;
+        current = next;
+    }
+}
+
+void ModalString::queueExcitation(int offset, double amp, float pos, int width, bool strike)
+{
+    Event event = { offset, amp, pos, width, strike };
+    if (offset <= 0 || numEvents == maxEvents)
+    {
+        applyEvent(event);
+        return;
+    }
+
+    // Insert sorted, events with the same offset keep their order
+    int i = numEvents;
+    while (i > 0 && events[i - 1].offset > event.offset)
+    {
+        events[i] = events[i - 1];
+        --i;
+    }
+    events[i] = event;
+    ++numEvents;
+}
+
+void ModalString::applyEvent(Event& event)
+{
+    exciteSystem(event.amp, event.pos, event.width, event.strike);
+}
+
+void ModalString::exciteSystem(double amp, float pos, int width, bool strike)
+{
+    // Same raised cosine on the same grid points as StiffString::exciteSystem. The string sets
+    // these points, so the difference with the current displacement is projected onto the modes
+    if (strike) amp *= 1.0 / (width * 0.7);
+    if (amp > 1.0) amp = 1.0;
+    if (width != excitationWindow.width) excitationWindow.calculate(width);
+
+    Spreading::forExcitation(excitationWindow, pos, N, [&](int l, double window)
+    {
+        double value = amp * window / eScalar;
+        calculateSines(double_Pi * l / N, numModes);
+
+        double u1 = 0.0, u2 = 0.0;
+        for (int m = 0; m < numModes; ++m)
+        {
+            u1 += q1[m] * sines[m];
+            u2 += q2[m] * sines[m];
+        }
+
+        // A unit displacement at grid point l has mode amplitudes 2 / N sin(m pi l / N)
+        double d2 = (value - u2) * 2.0 / N;
+        double d1 = strike ? 0.0 : (value - u1) * 2.0 / N;
+        for (int m = 0; m < numModes; ++m)
+        {
+            q2[m] += d2 * sines[m];
+            q1[m] += d1 * sines[m];
+        }
+    });
+
+    numActive = numModes;
+    updateActiveModes();
+}
+
+void ModalString::updateActiveModes()
+{
+    // Amplitude of each oscillator from two successive samples, the highest audible mode sets the count
+    double amplitudes = 0.0;
+    int highest = 0;
+    energy = 0.0;
+
+    for (int m = 0; m < numActive; ++m)
+    {
+        double cosine = c1[m] / (2.0 * sqrt(-c2[m]));
+        double sineSq = jmax(1.0 - cosine * cosine, 1e-12);
+        double ampSq = (q1[m] * q1[m] + q2[m] * q2[m] - 2.0 * cosine * q1[m] * q2[m]) / sineSq;
+
+        sines[m] = ampSq;
+        amplitudes = jmax(amplitudes, ampSq);
+        energy += e[m] * ampSq;
+    }
+
+    const double threshold = audibilityThreshold * audibilityThreshold * amplitudes;
+    for (int m = 0; m < numActive; ++m)
+        if (sines[m] > threshold) highest = m + 1;
+
+    for (int m = highest; m < numActive; ++m)
+        q1[m] = q2[m] = 0.0;
+    numActive = highest;
+}
+
+void ModalString::setPickups(const Pickups& pickups)
+{
+    this->pickups = pickups;
+    weightsValid = false;
+}
+
+void ModalString::calculateWeights()
+{
+    // Mode shapes at the pickup positions, clamped like the taps of the StiffString
+    fill(wL.begin(), wL.end(), 0.0);
+    fill(wR.begin(), wR.end(), 0.0);
+
+    for (int i = 0; i < pickups.getNumPickups(); ++i)
+    {
+        double x = jlimit(1.0, N - 2.0, static_cast<double> (pickups.getPickup(i).pos) * N);
+        const double left = eScalar * pickups.getGain(i, 0);
+        const double right = eScalar * pickups.getGain(i, 1);
+
+        calculateSines(double_Pi * x / N, numModes);
+        for (int m = 0; m < numModes; ++m)
+        {
+            wL[m] += left * sines[m];
+            wR[m] += right * sines[m];
+        }
+    }
+    weightsValid = true;
+}
+
+void ModalString::renderBlock(float* outL, float* outR, int numSamples)
+{
+    // Without outR both channels are mixed into outL
+    if (!weightsValid) calculateWeights();
+
+    int n = 0;
+    while (n < numSamples)
+    {
+        int e = 0;
+        while (e < numEvents && events[e].offset <= n)
+            applyEvent(events[e++]);
+        for (int i = e; i < numEvents; ++i)
+            events[i - e] = events[i];
+        numEvents -= e;
+
+        int end = (numEvents > 0 && events[0].offset < numSamples) ? events[0].offset : numSamples;
+        renderSamples(outL + n, outR != nullptr ? outR + n : nullptr, end - n);
+        n = end;
+    }
+
+    for (int i = 0; i < numEvents; ++i)
+        events[i].offset -= numSamples;
+
+    updateActiveModes();
+}
+
+void ModalString::renderSamples(float* outL, float* outR, int numSamples)
+{
+    double* a = q1;
+    double* b = q2;
+    const double* C1 = c1.data();
+    const double* C2 = c2.data();
+    const double* WL = wL.data();
+    const double* WR = wR.data();
+    const int M = numActive;
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        // Next state overwrites the oldest one, like the pointer switch of the StiffString
+        for (int m = 0; m < M; ++m)
+            b[m] = C1[m] * a[m] + C2[m] * b[m];
+        double* next = b;
+
+        // Four partial sums per channel, so the output sums vectorize without reordering by the compiler
+        double sumL[4] = { 0.0, 0.0, 0.0, 0.0 };
+        double sumR[4] = { 0.0, 0.0, 0.0, 0.0 };
+        int m = 0;
+        for (; m + 4 <= M; m += 4)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                sumL[j] += WL[m + j] * next[m + j];
+                sumR[j] += WR[m + j] * next[m + j];
+            }
+        }
+        for (; m < M; ++m)
+        {
+            sumL[0] += WL[m] * next[m];
+            sumR[0] += WR[m] * next[m];
+        }
+
+        float left = static_cast<float> ((sumL[0] + sumL[1]) + (sumL[2] + sumL[3]));
+        float right = static_cast<float> ((sumR[0] + sumR[1]) + (sumR[2] + sumR[3]));
+        if (outR != nullptr)
+        {
+            outL[n] = left;
+            outR[n] = right;
+        }
+        else outL[n] = 0.5f * (left + right);
+
+        b = a;
+        a = next;
+    }
+
+    q1 = a;
+    q2 = b;
+}
+
+template <typename FloatType>
+void ModalString::copyStateTo(StiffStringT<FloatType>& string)
+{
+    // Sums the modes on the grid points of the string, so it continues where the modes are.
+    // Pending excitations move along with the state
+    jassert(string.N == N && string.stride == 1);
+
+    for (int i = 0; i < 3; ++i)
+        fill(string.u[i] - 1, string.u[i] + string.maxN + 2, static_cast<FloatType> (0));
+
+    for (int l = 1; l < N; ++l)
+    {
+        calculateSines(double_Pi * l / N, numActive);
+        double u1 = 0.0, u2 = 0.0;
+        for (int m = 0; m < numActive; ++m)
+        {
+            u1 += q1[m] * sines[m];
+            u2 += q2[m] * sines[m];
+        }
+        string.u[1][l] = static_cast<FloatType> (u1);
+        string.u[2][l] = static_cast<FloatType> (u2);
+    }
+
+    for (int i = 0; i < numEvents; ++i)
+        string.queueExcitation(events[i].offset, events[i].amp, events[i].pos, events[i].width, events[i].strike);
+    numEvents = 0;
+
+    clearState();
+}
+
+template void ModalString::copyStateTo<float>(StiffStringT<float>&);
+template void ModalString::copyStateTo<double>(StiffStringT<double>&);
@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    ModalString.h
+    Created: 17 May 2022 3:05:52pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "StiffString.h"
+
+using namespace std;
+
+// Simply supported stiff string as a sum of its modes. Every mode is a damped oscillator with the
+// frequency and decay the finite difference scheme gives it, so linear excitations cost a few
+// operations per audible mode. Shares the grid of the StiffString for excitation and output
+class ModalString
+{
+
+public:
+    ModalString();      // Constructor
+    ~ModalString();     // Destructor
+
+    void allocate(int maxModes);
+    void setGrid(const GridCoefficients& grid);
+    void retune(const GridCoefficients& grid);
+    void setDamping(double sig0);
+    void queueExcitation(int offset, double amp, float pos, int width, bool strike);
+    void exciteSystem(double amp, float pos, int width, bool strike);
+    void renderBlock(float* outL, float* outR, int numSamples);
+    void setPickups(const Pickups& pickups);
+
+    template <typename FloatType>
+    void copyStateTo(StiffStringT<FloatType>& string);
+
+    int getNumModes() { return numModes; };
+    int getNumActiveModes() { return numActive; };
+    double getEnergy() { return energy; };
+    void clearState();
+    void writeState(MemoryOutputStream& stream);
+    bool readState(MemoryInputStream& stream, double timeScale);
+    bool hasPendingEvents() { return numEvents > 0; };
+
+    static constexpr double audibilityThreshold = 1e-6;    // modes below this amplitude relative to the largest are skipped
+
+private:
+    struct Event
+    {
+        int offset;
+        double amp; float pos; int width; bool strike;
+    };
+
+    void calculateModes();
+    void calculateWavenumbers();
+    double findWavenumber(int m);
+    void updateActiveModes();
+    void renderSamples(float* outL, float* outR, int numSamples);
+    void calculateWeights();
+    void applyEvent(Event& event);
+    void calculateSines(double theta, int num);
+
+    GridCoefficients grid {};
+    int N = 0;                                              // grid of the equivalent StiffString
+    int maxModes = 0;
+    int numModes = 0;                                       // modes on the grid, N - 1 at most
+    int numActive = 0;                                      // modes that are rendered
+    bool weightsValid = false;                              // output weights match the modes and pickups
+
+    vector<double> qStates;                                 // two rows of mode displacements
+    double* q1 = nullptr;                                   // mode displacements at n
+    double* q2 = nullptr;                                   // mode displacements at n - 1
+    vector<double> c1, c2;                                  // q0 = c1 * q1 + c2 * q2
+    vector<double> thetas;                                  // wavenumber of every mode on the grid
+    vector<double> wL, wR;                                  // output weight of every mode per channel
+    Pickups pickups;
+    vector<double> e;                                       // energy of every mode at unit amplitude
+    double energy = 0.0;                                    // energy of the modes, updated every block
+    vector<double> sines;                                   // sin(m theta) or amplitude of every mode, scratch
+    Spreading::Window excitationWindow;                     // raised cosine of the last excitation width
+
+    double eScalar = 500.0;                                 // same output scaling as StiffString
+
+    static const int maxEvents = 32;
+    Event events[maxEvents];
+    int numEvents = 0;
+};
@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    Pickups.cpp
+    Created: 2 Jun 2022 4:18:27pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "Pickups.h"
+
+Pickups::Pickups()
+{
+    // One centred pickup at the position the strings always used
+    Pickup pickup = { 0.2f, 0.5f };
+    setPickups(&pickup, 1);
+}
+
+Pickups::~Pickups()
+{
+
+}
+
+void Pickups::setPickups(const Pickup* pickups, int numPickups)
+{
+    // Taps are calculated by the owner of the grid with calculateTaps
+    this->numPickups = jmin(numPickups, maxPickups);
+    for (int i = 0; i < this->numPickups; ++i)
+        this->pickups[i] = pickups[i];
+    numTaps = 0;
+}
+
+double Pickups::getGain(int i, int channel) const
+{
+    // Balance law, so a centred pickup has unit gain in both channels
+    double pan = jlimit(0.0f, 1.0f, pickups[i].pan);
+    return channel == 0 ? jmin(1.0, 2.0 * (1.0 - pan)) : jmin(1.0, 2.0 * pan);
+}
+
+void Pickups::calculateTaps(int N, double scale)
+{
+    numTaps = 0;
+    if (N < 3) return;
+
+    for (int i = 0; i < numPickups; ++i)
+    {
+        // The four points around the pickup stay on the grid, points 0 and N are the zero boundaries
+        double x = jlimit(1.0, N - 2.0, static_cast<double> (pickups[i].pos) * N);
+        int l = jmin(static_cast<int> (x), N - 2);
+        double a = x - l;
+
+        double weights[4];
+        Spreading::lagrangeWeights(a, weights);
+
+        const double left = scale * getGain(i, 0);
+        const double right = scale * getGain(i, 1);
+
+        for (int j = 0; j < 4; ++j)
+        {
+            int idx = l - 1 + j;
+            if (weights[j] == 0.0) continue;
+
+            // Merge with a tap of an earlier pickup on the same grid point
+            int t = 0;
+            while (t < numTaps && tapIdx[t] != idx) ++t;
+            if (t == numTaps)
+            {
+                tapIdx[t] = idx;
+                tapLeft[t] = tapRight[t] = 0.0;
+                ++numTaps;
+            }
+            tapLeft[t] += weights[j] * left;
+            tapRight[t] += weights[j] * right;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    Pickups.h
+    Created: 2 Jun 2022 4:18:27pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Spreading.h"
+
+// Output positions along the string, each with a pan. Every pickup reads the grid with cubic
+// Lagrange interpolation between its four nearest points. The weights of all pickups are merged
+// per grid point and per channel once per grid, so a sample is one pass over a few taps
+class Pickups
+{
+
+public:
+    struct Pickup
+    {
+        float pos;      // relative position along the string
+        float pan;      // 0 is left, 0.5 centre and 1 right
+    };
+
+    static const int maxPickups = 8;
+    static const int maxTaps = 4 * maxPickups;
+
+    Pickups();      // Constructor
+    ~Pickups();     // Destructor
+
+    void setPickups(const Pickup* pickups, int numPickups);
+    void calculateTaps(int N, double scale);
+    int getNumPickups() const { return numPickups; };
+    const Pickup& getPickup(int i) const { return pickups[i]; };
+    double getGain(int i, int channel) const;
+
+    template <typename FloatType>
+    void gather(const FloatType* u, int stride, float& left, float& right) const
+    {
+        double l = 0.0, r = 0.0;
+        for (int t = 0; t < numTaps; ++t)
+        {
+            double value = u[tapIdx[t] * stride];
+            l += tapLeft[t] * value;
+            r += tapRight[t] * value;
+        }
+        left = static_cast<float> (l);
+        right = static_cast<float> (r);
+    };
+
+private:
+    Pickup pickups[maxPickups];
+    int numPickups = 0;
+
+    int numTaps = 0;
+    int tapIdx[maxTaps];                    // grid points read by the pickups
+    double tapLeft[maxTaps];                // weight of every grid point in the left channel
+    double tapRight[maxTaps];
+};
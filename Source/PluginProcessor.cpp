@@ -87,6 +87,45 @@ StiffStringPluginAudioProcessor::StiffStringPluginAudioProcessor()
         false   // default value
     )); // default value
 
+    // Added after the original parameters, hosts address parameters by index
+    addParameter(singlePrecision = new AudioParameterBool("singlePrecision", // parameter ID
+        "single precision", // parameter name
+        false   // default value
+    )); // default value
+
+    addParameter(simulationRate = new AudioParameterChoice("simulationRate", // parameter ID
+        "simulation rate", // parameter name
+        StringArray("host rate", "44.1/48 kHz", "88.2/96 kHz"),
+        0));          // default value
+
+    addParameter(resamplerQuality = new AudioParameterChoice("resamplerQuality", // parameter ID
+        "resampler quality", // parameter name
+        StringArray("low", "medium", "high"),
+        1));          // default value
+
+    addParameter(theta = new AudioParameterFloat("theta", // parameter ID
+        "theta", // parameter name
+        0.0f,          // minimum value
+        1.0f,       // maximum value
+        1.0f));          // default value
+
+    addParameter(gridScale = new AudioParameterFloat("gridScale", // parameter ID
+        "grid scale", // parameter name
+        0.1f,          // minimum value
+        1.0f,       // maximum value
+        1.0f));          // default value
+
+    addParameter(tension = new AudioParameterFloat("tension", // parameter ID
+        "tension modulation", // parameter name
+        0.0f,          // minimum value
+        1.0f,       // maximum value
+        0.0f));          // default value
+
+    addParameter(sympathetic = new AudioParameterFloat("sympathetic", // parameter ID
+        "sympathetic strings", // parameter name
+        0.0f,          // minimum value
+        1.0f,       // maximum value
+        0.0f));          // default value
 
 #endif
 }
@@ -130,7 +169,10 @@ bool StiffStringPluginAudioProcessor::isMidiEffect() const
 
 double StiffStringPluginAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // Energy decays with exp(-2 sig0 t), the strings ring until it reaches the sleep level of the voices
+    double sig0 = parameters.read().sig0;
+    if (sig0 <= 0.0) return std::numeric_limits<double>::infinity();
+    return -log(voices.sleepLevel) / (2.0 * sig0);
 }
 
 int StiffStringPluginAudioProcessor::getNumPrograms()
@@ -160,25 +202,42 @@ void StiffStringPluginAudioProcessor::changeProgramName (int index, const juce::
 //==============================================================================
 void StiffStringPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    stiffString.setFs(sampleRate);
-
 #ifdef NOEDITOR
     f0 = *fundFreq;
 #endif // NOEDITOR
 
-    parameters.set("L", 1.0);
-    parameters.set("E", 2e11);
-    parameters.set("f0", f0);
-
     updateParameters();
+    parametersVersion = parameters.getVersion();
+
+    // The strings can run at a rate of their own, 48 kHz or 44.1 kHz depending on the host family,
+    // so a higher host rate does not grow the grids. Both take effect here, at the next prepare
+    double simulationFs = 0.0;
+#ifdef NOEDITOR
+    const double baseFs = fmod(sampleRate, 48000.0) == 0.0 ? 48000.0 : 44100.0;
+    if (simulationRate->getIndex() > 0) simulationFs = baseFs * simulationRate->getIndex();
+    voices.setSimulationRate(simulationFs, static_cast<Resampler::Quality> (resamplerQuality->getIndex()));
+#endif // NOEDITOR
 
-    stiffString.setGrid(parameters);
+    // Size the voices for the largest grid: the lowest note on an infinitely thin, undamped string
+    int maxGridSize = StiffString::calculateGridSize(jmax(sampleRate, simulationFs), MidiMessage::getMidiNoteInHertz(0), 1.0, 0.0, 0.0);
+    if (maxGridSize > StiffString::maxGridSize) maxGridSize = StiffString::maxGridSize;
+
+    voices.prepare(sampleRate, parameters.read(), maxGridSize, numVoices, samplesPerBlock, SystemStats::getNumPhysicalCpus() - 1);
+    setLatencySamples(roundToInt(voices.getLatency()));      // delay of the resampler, 0 at the host rate
+
+    // Two pickups, spread over the stereo image
+    const Pickups::Pickup pickups[] = { { 0.2f, 0.3f }, { 0.67f, 0.7f } };
+    voices.setPickups(pickups, 2);
+
+    isPrepared = true;
+    if (pendingStrings.getSize() > 0) applyStringState();
 }
 
 void StiffStringPluginAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    voices.releaseResources();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -222,77 +281,102 @@ void StiffStringPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buf
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
-    // MIDI Input
-    MidiBuffer::Iterator it(midiMessages);
-    MidiMessage currentMessage;
-    int samplePos;
-
-#ifdef MIDIINPUT
-    while (it.getNextEvent(currentMessage, samplePos))
-    {
-        if (currentMessage.isNoteOn())
-        {
-            f0 = currentMessage.getMidiNoteInHertz(currentMessage.getNoteNumber());
-            parameters.set("f0", currentMessage.getMidiNoteInHertz(currentMessage.getNoteNumber()));
-            stiffString.setGrid(parameters);
-
-            stiffString.exciteSystem(eAmp, ePos, eWidth, isStriked);
-        }
-    }
-#endif
 #ifdef NOEDITOR
 
     if (*excited)
     {
-        if (f0 != *fundFreq)
+        if (f0 != *fundFreq || !voices.isNoteActive(parameterNote))
         {
             f0 = *fundFreq;
-            parameters.set("f0", f0);
-            stiffString.setGrid(parameters);
+            voices.noteOn(parameterNote, f0);
         }
         
         if (eType == "bowed")
         {
-            stiffString.vb = *bowVelocity;
-            stiffString.bowed = true;
-            stiffString.ePos = *position;
+            voices.setBow(parameterNote, 0, true, *bowVelocity, *position);
         }
 
         if (eType == "plucked" || eType == "striked")
         {
-            stiffString.exciteSystem(eAmp, ePos, eWidth, isStriked);
+            voices.exciteNote(parameterNote, 0, eAmp, ePos, eWidth, isStriked);
             *excited = false;
         }
     }
 
     if (!*excited && eType == "bowed")
     {
-        stiffString.vb = 0.0; 
+        voices.setBow(parameterNote, 0, true, 0.0, *position);
     }
 
     if (*paramChanged)
     {
         updateParameters();
-        stiffString.setGrid(parameters);
         *paramChanged = false;
     }
 
     if (ePos != *position) ePos = *position; 
+    voices.setSympathetic(*sympathetic);
 
 #endif // NOEDITOR
 
-    for (int n = 0; n < buffer.getNumSamples(); ++n)
+    // Rebuild the grids when new parameters have been published
+    if (parameters.getVersion() != parametersVersion)
+    {
+        parametersVersion = parameters.getVersion();
+        voices.updateGrids(parameters.read());
+    }
+
+    // Stereo from the pickups, a mono bus gets both channels mixed
+    auto outL = buffer.getWritePointer(0);
+    auto outR = totalNumOutputChannels > 1 ? buffer.getWritePointer(1) : nullptr;
+    const int numSamples = buffer.getNumSamples();
+    int start = 0;
+
+#ifdef MIDIINPUT
+    // Render up to every MIDI event and apply it at the first sample of the next sub-block,
+    // so note timing does not depend on the buffer size
+    MidiBuffer::Iterator it(midiMessages);
+    MidiMessage currentMessage;
+    int samplePos;
+
+    while (it.getNextEvent(currentMessage, samplePos))
     {
-        auto outL = buffer.getWritePointer(0);
-        auto outR = buffer.getWritePointer(1);
+        samplePos = jlimit(start, numSamples, samplePos);
+        if (samplePos > start)
+        {
+            voices.process(outL + start, outR != nullptr ? outR + start : nullptr, samplePos - start);
+            start = samplePos;
+        }
+        handleMidiMessage(currentMessage);
+    }
+#endif
+
+    voices.process(outL + start, outR != nullptr ? outR + start : nullptr, numSamples - start);
 
-        float out = 0.f;
+    for (int n = 0; n < numSamples; ++n)
+        outL[n] = limit(outL[n]);
+
+    if (outR != nullptr)
+    {
+        for (int n = 0; n < numSamples; ++n)
+            outR[n] = limit(outR[n]);
+    }
 
-        out = stiffString.getNextSample(0.2);
+    for (int channel = 2; channel < totalNumOutputChannels; ++channel)
+        buffer.copyFrom(channel, 0, outL, numSamples);
+}
 
-        out = limit(out);
-        outL[n] = out;
-        outR[n] = out;
+void StiffStringPluginAudioProcessor::handleMidiMessage(const MidiMessage& message)
+{
+    if (message.isNoteOn())
+    {
+        int note = message.getNoteNumber();
+        voices.noteOn(note, message.getMidiNoteInHertz(note));
+        voices.exciteNote(note, 0, eAmp, ePos, eWidth, isStriked);
+    }
+    else if (message.isNoteOff())
+    {
+        voices.noteOff(message.getNoteNumber());
     }
 }
 
@@ -314,15 +398,90 @@ juce::AudioProcessorEditor* StiffStringPluginAudioProcessor::createEditor()
 //==============================================================================
 void StiffStringPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    // Magic and version, the parameters by ID, then optionally the sounding strings. The callback
+    // lock keeps the voices still while they are written
+    MemoryOutputStream stream(destData, false);
+    stream.writeInt(stateMagic);
+    stream.writeInt(stateVersion);
+
+    Array<AudioProcessorParameterWithID*> stored;
+    for (auto* parameter : getParameters())
+    {
+#ifdef NOEDITOR
+        if (parameter == excited || parameter == paramChanged) continue;   // triggers, not state
+#endif // NOEDITOR
+        if (auto* withID = dynamic_cast<AudioProcessorParameterWithID*> (parameter))
+            stored.add(withID);
+    }
+
+    stream.writeInt(stored.size());
+    for (auto* parameter : stored)
+    {
+        stream.writeString(parameter->paramID);
+        stream.writeFloat(parameter->getValue());
+    }
+
+    const ScopedLock lock(getCallbackLock());
+    if (!isPrepared && pendingStrings.getSize() > 0)
+    {
+        // Restored but not played yet, saved again as it came in
+        stream.writeBool(true);
+        stream.write(pendingStrings.getData(), pendingStrings.getSize());
+        return;
+    }
+
+    stream.writeBool(storeStrings && isPrepared);
+    if (storeStrings && isPrepared) voices.writeState(stream);
 }
 
 void StiffStringPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    // States of a newer version or another plugin are ignored. Parameters missing from the state
+    // keep their values
+    MemoryInputStream stream(data, static_cast<size_t> (sizeInBytes), false);
+    if (sizeInBytes < 8 || stream.readInt() != stateMagic) return;
+    const int version = stream.readInt();
+    if (version < 1 || version > stateVersion) return;
+
+    const int numParameters = stream.readInt();
+    for (int i = 0; i < numParameters && !stream.isExhausted(); ++i)
+    {
+        const String id = stream.readString();
+        const float value = stream.readFloat();
+        if (!std::isfinite(value)) continue;
+        for (auto* parameter : getParameters())
+        {
+            auto* withID = dynamic_cast<AudioProcessorParameterWithID*> (parameter);
+            if (withID != nullptr && withID->paramID == id) parameter->setValueNotifyingHost(jlimit(0.0f, 1.0f, value));
+        }
+    }
+
+    const ScopedLock lock(getCallbackLock());
+#ifdef NOEDITOR
+    f0 = *fundFreq;
+#endif // NOEDITOR
+    updateParameters();
+
+    // The strings need the voices, before the first prepareToPlay they wait there
+    pendingStrings.reset();
+    if (!stream.isExhausted() && stream.readBool())
+    {
+        pendingStrings.setSize(static_cast<size_t> (stream.getNumBytesRemaining()));
+        stream.read(pendingStrings.getData(), static_cast<int> (pendingStrings.getSize()));
+    }
+    if (isPrepared && pendingStrings.getSize() > 0) applyStringState();
+}
+
+void StiffStringPluginAudioProcessor::applyStringState()
+{
+    // The cache takes the restored parameters first, the voices then pick their grids from it.
+    // A grid of the same size takes the saved state as it is, without a rebuild
+    parametersVersion = parameters.getVersion();
+    voices.updateGrids(parameters.read());
+
+    MemoryInputStream stream(pendingStrings, false);
+    voices.readState(stream);
+    pendingStrings.reset();
 }
 
 //==============================================================================
@@ -346,7 +505,7 @@ void StiffStringPluginAudioProcessor::updateParameters()
     if (*excitationType <= 0.33f)
     {
         eType = "plucked";
-        stiffString.bowed = false;
+        voices.setBow(parameterNote, 0, false, 0.0, *position);
         isStriked = false;
     }
     if (*excitationType > 0.33f && *excitationType <= 0.66f)
@@ -357,7 +516,7 @@ void StiffStringPluginAudioProcessor::updateParameters()
     if (*excitationType > 0.66f)
     {
         eType = "striked";
-        stiffString.bowed = false;
+        voices.setBow(parameterNote, 0, false, 0.0, *position);
         isStriked = true;
     }
 
@@ -366,10 +525,18 @@ void StiffStringPluginAudioProcessor::updateParameters()
     double rho = *density;
     double rad = *radius * 0.001; // transforms radius from mm to m 
 
-    parameters.set("rho", rho);
-    parameters.set("r", rad);
-    parameters.set("sig0", sig0);
-    parameters.set("sig1", sig1);
+    StringParams params;
+    params.f0 = f0;
+    params.rho = rho;
+    params.r = rad;
+    params.sig0 = sig0;
+    params.sig1 = sig1;
+    params.theta = *theta;            // below 1 the strings use the implicit scheme
+    params.gridScale = *gridScale;
+    params.tension = *tension;        // above 0 hard plucks glide down in pitch
+    parameters.publish(params);
+
+    voices.setSinglePrecision(*singlePrecision);  // applies to the next started notes
 
     ePos = *position;
 #endif // 
@@ -9,7 +9,7 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include "StiffString.h"
+#include "VoicePool.h"
 
 #define NOEDITOR
 //#define MIDIINPUT
@@ -57,11 +57,20 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    NamedValueSet parameters;
+    StringParamsBuffer parameters;     // string parameters, published by any thread and read in processBlock
+    bool storeStrings = true;          // the saved state also holds the sounding strings
 
 private:
     double f0 = 220.0f;
     void updateParameters();
+    void handleMidiMessage(const MidiMessage& message);
+    void applyStringState();
+    uint32 parametersVersion = 0;     // version of the parameters the voices are built with
+
+    bool isPrepared = false;          // the voices are allocated
+    MemoryBlock pendingStrings;       // restored string state, applied once the voices are allocated
+    static const int stateMagic = 0x53535453;   // "SSTS"
+    static const int stateVersion = 1;
 
 #ifdef NOEDITOR
     
@@ -72,6 +81,13 @@ private:
     AudioParameterFloat* sigma1;
     AudioParameterFloat* radius;
     AudioParameterFloat* density;
+    AudioParameterBool* singlePrecision;
+    AudioParameterChoice* simulationRate;
+    AudioParameterChoice* resamplerQuality;
+    AudioParameterFloat* theta;
+    AudioParameterFloat* gridScale;
+    AudioParameterFloat* tension;
+    AudioParameterFloat* sympathetic;
     
     // Excitation
     AudioParameterFloat* excitationType; 
@@ -84,8 +100,10 @@ private:
     AudioParameterBool* paramChanged;
 #endif // NOEDITOR
 
-    // String
-    StiffString stiffString;
+    // Strings
+    VoicePool voices;
+    static const int numVoices = 8;
+    static const int parameterNote = 128;   // voice played through the parameters
 
     double ePos;              // excitation position
     double eAmp = 1.0f;       // plucked excitation gain 0-1
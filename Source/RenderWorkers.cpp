@@ -0,0 +1,172 @@
+/*
+  ==============================================================================
+
+    RenderWorkers.cpp
+    Created: 16 Mar 2022 11:03:47am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "RenderWorkers.h"
+
+RenderWorkers::RenderWorkers()
+{
+
+}
+
+RenderWorkers::~RenderWorkers()
+{
+    stop();
+}
+
+void RenderWorkers::start(int numWorkers)
+{
+    stop();
+
+    queues = std::vector<JobQueue>(numWorkers + 1);
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        // No affinity, the scheduler knows which cores are free across instances and SMT siblings
+        workers.push_back(std::make_unique<Worker>(*this, i));
+        workers.back()->startThread(10);
+    }
+}
+
+void RenderWorkers::stop()
+{
+    for (auto& worker : workers)
+    {
+        worker->signalThreadShouldExit();
+        worker->wakeUp.signal();
+    }
+    for (auto& worker : workers)
+        worker->stopThread(1000);
+
+    workers.clear();
+}
+
+void RenderWorkers::run(RenderJobs& jobs, int numJobs, double deadlineSeconds)
+{
+    int numQueues = static_cast<int> (queues.size());
+
+    // Without workers, or with a single job, everything is rendered inline
+    if (workers.empty() || numJobs < 2)
+    {
+        for (int i = 0; i < numJobs; ++i)
+            jobs.renderJob(i);
+        lateJobs = 0;
+        return;
+    }
+
+    // Split the jobs in contiguous ranges, one per queue. The cursors carry the block
+    // generation, so a worker that is still busy with an old block cannot claim new jobs
+    uint32 block = generation.load(std::memory_order_relaxed) + 1;
+
+    currentJobs.store(&jobs, std::memory_order_relaxed);
+    this->numJobs = numJobs;
+    lateJobs = 0;
+    jobsDone.store(0, std::memory_order_relaxed);
+    deadline.store(Time::getHighResolutionTicks()
+        + static_cast<int64> (deadlineSeconds * Time::getHighResolutionTicksPerSecond()), std::memory_order_relaxed);
+
+    for (int q = 0; q < numQueues; ++q)
+    {
+        int start = numJobs * q / numQueues;
+        queues[q].start.store(start, std::memory_order_relaxed);
+        queues[q].size.store(numJobs * (q + 1) / numQueues - start, std::memory_order_relaxed);
+        queues[q].cursor.store(static_cast<uint64> (block) << 32, std::memory_order_release);
+    }
+
+    // Publish the block, only sleeping workers need the (non-lock-free) wake-up call
+    generation.store(block, std::memory_order_release);
+    for (auto& worker : workers)
+        if (worker->isSleeping.load(std::memory_order_acquire))
+            worker->wakeUp.signal();
+
+    // The host works on its own queue and then steals whatever the workers did not claim
+    workOn(numQueues - 1, block, false);
+
+    // Barrier: only jobs already claimed by a worker can still be in flight
+    while (jobsDone.load(std::memory_order_acquire) < numJobs)
+        ;
+}
+
+bool RenderWorkers::claimJob(int queue, uint32 block, int& job)
+{
+    JobQueue& q = queues[queue];
+    uint64 cursor = q.cursor.load(std::memory_order_acquire);
+
+    while (true)
+    {
+        int position = static_cast<int> (cursor & 0xffffffff);
+        if (static_cast<uint32> (cursor >> 32) != block || position >= q.size.load(std::memory_order_relaxed))
+            return false;
+
+        if (q.cursor.compare_exchange_weak(cursor, cursor + 1, std::memory_order_acq_rel))
+        {
+            job = q.start.load(std::memory_order_relaxed) + position;
+            return true;
+        }
+    }
+}
+
+void RenderWorkers::workOn(int queue, uint32 block, bool checkDeadline)
+{
+    int numQueues = static_cast<int> (queues.size());
+    int job;
+
+    // Own queue first, then steal from the others
+    for (int i = 0; i < numQueues; ++i)
+    {
+        int q = (queue + i) % numQueues;
+        while (true)
+        {
+            if (checkDeadline && Time::getHighResolutionTicks() > deadline.load(std::memory_order_relaxed))
+                return;
+            if (!claimJob(q, block, job))
+                break;
+
+            // The host steals straight away, only jobs still unclaimed after the deadline were late
+            if (!checkDeadline && i > 0 && Time::getHighResolutionTicks() > deadline.load(std::memory_order_relaxed)) ++lateJobs;
+            currentJobs.load(std::memory_order_relaxed)->renderJob(job);
+            jobsDone.fetch_add(1, std::memory_order_release);
+        }
+    }
+}
+
+//==============================================================================
+RenderWorkers::Worker::Worker(RenderWorkers& owner, int index)
+    : Thread("StiffString render worker " + String(index)), owner(owner), index(index)
+{
+
+}
+
+void RenderWorkers::Worker::run()
+{
+    // Same floating point mode as the audio thread, denormals in a decaying string are flushed
+    ScopedNoDenormals noDenormals;
+    uint32 lastGeneration = owner.generation.load(std::memory_order_acquire);
+
+    while (!threadShouldExit())
+    {
+        // Spin shortly for the next block before going to sleep
+        uint32 current = lastGeneration;
+        for (int spin = 0; spin < 20000 && current == lastGeneration; ++spin)
+            current = owner.generation.load(std::memory_order_acquire);
+
+        if (current == lastGeneration)
+        {
+            isSleeping.store(true, std::memory_order_release);
+            current = owner.generation.load(std::memory_order_acquire);
+            if (current == lastGeneration)
+                wakeUp.wait(10);
+            isSleeping.store(false, std::memory_order_release);
+            continue;
+        }
+
+        lastGeneration = current;
+        owner.workOn(index, current, true);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    RenderWorkers.h
+    Created: 16 Mar 2022 11:03:47am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+
+// Interface for anything that can render a list of independent jobs
+class RenderJobs
+{
+public:
+    virtual ~RenderJobs() {}
+    virtual void renderJob(int job) = 0;
+};
+
+class RenderWorkers
+{
+
+public:
+    RenderWorkers();      // Constructor
+    ~RenderWorkers();     // Destructor
+
+    void start(int numWorkers);
+    void stop();
+    void run(RenderJobs& jobs, int numJobs, double deadlineSeconds);
+
+    int getNumWorkers() { return static_cast<int> (workers.size()); };
+    int getNumLateJobs() { return lateJobs; };
+
+private:
+    struct JobQueue
+    {
+        std::atomic<uint64> cursor { 0 };               // block generation (high bits) and next unclaimed position
+        std::atomic<int> start { 0 }, size { 0 };       // range of jobs in this queue
+        char padding[48];                               // keep queues on separate cache lines
+    };
+
+    class Worker : public Thread
+    {
+    public:
+        Worker(RenderWorkers& owner, int index);
+        void run() override;
+
+        WaitableEvent wakeUp;
+        std::atomic<bool> isSleeping { false };
+    private:
+        RenderWorkers& owner;
+        int index;
+    };
+
+    bool claimJob(int queue, uint32 block, int& job);
+    void workOn(int queue, uint32 block, bool checkDeadline);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<JobQueue> queues;                       // one per worker, the last one is the host's
+
+    std::atomic<RenderJobs*> currentJobs { nullptr };
+    std::atomic<uint32> generation { 0 };               // incremented for every dispatched block
+    std::atomic<int> jobsDone { 0 };
+    std::atomic<int64> deadline { 0 };                  // workers do not claim jobs after this tick
+    int numJobs = 0;
+    int lateJobs = 0;                                   // jobs the host took from a worker after the deadline in the last block
+};
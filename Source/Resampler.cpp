@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    Resampler.cpp
+    Created: 24 May 2022 11:40:18am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "Resampler.h"
+
+Resampler::Resampler()
+{
+
+}
+
+Resampler::~Resampler()
+{
+
+}
+
+bool Resampler::prepare(double inputFs, double outputFs, Quality quality, int maxOutputSamples)
+{
+    // Returns false when the rates are equal or their ratio needs too many phases
+    active = false;
+
+    int64 in = static_cast<int64> (round(inputFs));
+    int64 out = static_cast<int64> (round(outputFs));
+    if (in <= 0 || out <= 0 || in == out || in != inputFs || out != outputFs) return false;
+
+    int64 a = in, b = out;
+    while (b != 0) { int64 t = a % b; a = b; b = t; }
+    if (out / a > maxPhases) return false;
+
+    L = static_cast<int> (out / a);
+    M = static_cast<int> (in / a);
+
+    const int tapsPerQuality[] = { 16, 32, 64 };
+    const double rolloffPerQuality[] = { 0.85, 0.9, 0.95 };
+    const double betaPerQuality[] = { 6.0, 8.0, 10.0 };
+    numTaps = tapsPerQuality[quality];
+
+    // Prototype at L times the input rate, cut off below the lower Nyquist frequency
+    const int length = L * numTaps;
+    const double cutoff = rolloffPerQuality[quality] * 0.5 * jmin(1.0, static_cast<double> (L) / M) / L;
+    const double centre = 0.5 * (length - 1);
+    const double beta = betaPerQuality[quality];
+
+    filter = vector<float>(length, 0.0f);
+    for (int n = 0; n < length; ++n)
+    {
+        double x = n - centre;
+        double sinc = x == 0.0 ? 2.0 * cutoff : sin(2.0 * double_Pi * cutoff * x) / (double_Pi * x);
+        double r = 2.0 * x / (length - 1);
+        double window = besselI0(beta * sqrt(jmax(0.0, 1.0 - r * r))) / besselI0(beta);
+
+        // Phase p holds the taps p, p + L, ..., time reversed, scaled by L for the inserted zeros
+        int p = n % L;
+        int t = n / L;
+        filter[p * numTaps + numTaps - 1 - t] = static_cast<float> (L * sinc * window);
+    }
+
+    history = vector<float>(numTaps - 1 + getMaxInput(maxOutputSamples), 0.0f);
+    reset();
+    active = true;
+    return true;
+}
+
+void Resampler::reset()
+{
+    fill(history.begin(), history.end(), 0.0f);
+    phase = L;              // the first output needs the first input
+}
+
+int Resampler::getNumInput(int numOutput) const
+{
+    // Inputs consumed by the next numOutput outputs
+    if (numOutput <= 0) return 0;
+    return static_cast<int> ((phase + static_cast<int64> (numOutput - 1) * M) / L);
+}
+
+int Resampler::getMaxInput(int numOutput) const
+{
+    return static_cast<int> ((L + static_cast<int64> (numOutput) * M) / L) + 1;
+}
+
+double Resampler::getLatency() const
+{
+    // Delay of the linear phase filter in output samples
+    return 0.5 * (L * numTaps - 1) / M;
+}
+
+void Resampler::process(const float* in, int numInput, float* out, int numOutput)
+{
+    // Adds numOutput samples to out, in holds the getNumInput(numOutput) inputs they need
+    jassert(numInput == getNumInput(numOutput));
+
+    const int history0 = numTaps - 1;
+    copy(in, in + numInput, history.begin() + history0);
+
+    // idx is one past the newest input in use
+    int idx = history0;
+    for (int n = 0; n < numOutput; ++n)
+    {
+        while (phase >= L)
+        {
+            phase -= L;
+            ++idx;
+        }
+
+        const float* x = &history[idx - numTaps];
+        const float* h = &filter[phase * numTaps];
+
+        // numTaps is a multiple of four, four partial sums let the dot product vectorize
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int t = 0; t < numTaps; t += 4)
+            for (int j = 0; j < 4; ++j)
+                sum[j] += h[t + j] * x[t + j];
+        out[n] += (sum[0] + sum[1]) + (sum[2] + sum[3]);
+
+        phase += M;
+    }
+
+    // Keep the newest numTaps - 1 inputs for the next block
+    copy(history.begin() + numInput, history.begin() + numInput + history0, history.begin());
+}
+
+double Resampler::besselI0(double x)
+{
+    // Power series of the modified Bessel function, converges quickly for the window betas
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; ++k)
+    {
+        term *= (0.5 * x / k) * (0.5 * x / k);
+        sum += term;
+        if (term < 1e-12 * sum) break;
+    }
+    return sum;
+}
@@ -0,0 +1,50 @@
+/*
+  ==============================================================================
+
+    Resampler.h
+    Created: 24 May 2022 11:40:18am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+using namespace std;
+
+// Rational polyphase resampler from the simulation rate of the strings to the host rate. The
+// ratio L / M is reduced from the two rates, every output sample is one phase of a Kaiser
+// windowed sinc with the cutoff below the lower of the two Nyquist frequencies
+class Resampler
+{
+
+public:
+    enum Quality { low, medium, high };     // taps per phase and stopband, from cheap to clean
+
+    Resampler();      // Constructor
+    ~Resampler();     // Destructor
+
+    bool prepare(double inputFs, double outputFs, Quality quality, int maxOutputSamples);
+    void reset();
+    bool isActive() const { return active; };
+
+    int getNumInput(int numOutput) const;
+    int getMaxInput(int numOutput) const;
+    void process(const float* in, int numInput, float* out, int numOutput);
+    double getLatency() const;
+
+    static const int maxPhases = 1024;      // larger ratios play at the host rate instead
+
+private:
+    static double besselI0(double x);
+
+    bool active = false;
+    int L = 1, M = 1;                       // upsampling and downsampling factor
+    int numTaps = 0;                        // taps per phase
+    int phase = 0;                          // position of the next output, in 1 / L input samples
+    vector<float> filter;                   // time reversed phases of the prototype, numTaps each
+    vector<float> history;                  // last numTaps - 1 inputs followed by the new block
+};
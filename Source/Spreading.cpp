@@ -0,0 +1,31 @@
+/*
+  ==============================================================================
+
+    Spreading.cpp
+    Created: 9 Jun 2022 10:37:14am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "Spreading.h"
+
+void Spreading::lagrangeWeights(double a, double* weights)
+{
+    // Points l - 1, l, l + 1 and l + 2 for the position l + a, 0 <= a < 1
+    weights[0] = -a * (a - 1.0) * (a - 2.0) / 6.0;
+    weights[1] = (a + 1.0) * (a - 1.0) * (a - 2.0) / 2.0;
+    weights[2] = -(a + 1.0) * a * (a - 2.0) / 2.0;
+    weights[3] = (a + 1.0) * a * (a - 1.0) / 6.0;
+}
+
+void Spreading::Window::calculate(int width)
+{
+    // Wider windows are cut to the table, which is several times the widest excitation
+    this->width = jlimit(0, maxWindowWidth, width);
+    for (int i = 0; i < this->width; ++i)
+    {
+        cosines[i] = cos(2.0 * double_Pi * i / this->width);
+        sines[i] = sin(2.0 * double_Pi * i / this->width);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    Spreading.h
+    Created: 9 Jun 2022 10:37:14am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+
+// Operators between a fractional position along the string and the grid points around it.
+// Cubic Lagrange weights interpolate at a point and spread a point force, the excitation
+// window is a raised cosine precomputed by every string with its grid
+class Spreading
+{
+
+public:
+    static const int maxWindowWidth = 64;
+
+    // cos and sin of 2 pi i / width for every point under the window, so an excitation only
+    // rotates them by its fractional start instead of taking a cos per grid point
+    struct Window
+    {
+        void calculate(int width);
+
+        static const int defaultWidth = 15;             // the width the plugin plucks with, calculated with the grid
+
+        int width = 0;                                  // no points until it is calculated
+        double cosines[maxWindowWidth];
+        double sines[maxWindowWidth];
+    };
+
+    static void lagrangeWeights(double a, double* weights);
+
+    // Calls function(l, value) for the grid points under the raised cosine of the window,
+    // centred at pos * N, moved away from the left boundary like the excitation always was
+    template <typename Function>
+    static void forExcitation(const Window& window, float pos, int N, Function function)
+    {
+        const int width = window.width;
+        if (width == 0) return;
+
+        double start = pos * N - width * 0.5;
+        if (start < 1.0) start = 1.0;
+
+        const int first = static_cast<int> (ceil(start));
+        const double phase = 2.0 * double_Pi * (first - start) / width;
+        const double c = cos(phase), s = sin(phase);
+
+        for (int i = 0; first + i < start + width; ++i)
+        {
+            if (first + i > N - 2) break;
+            function(first + i, 0.5 * (1.0 - (window.cosines[i] * c - window.sines[i] * s)));
+        }
+    };
+};
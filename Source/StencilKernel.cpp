@@ -0,0 +1,617 @@
+/*
+  ==============================================================================
+
+    StencilKernel.cpp
+    Created: 21 Mar 2022 4:40:18pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "StencilKernel.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+// The vector kernels add and multiply in the same order as the scalar one and must not be
+// contracted into fused multiply-adds, so all of them give bit-identical results. This holds for
+// the scalar kernel on every target, GCC contracts by default where the CPU has FMA, like aarch64
+#if defined(__clang__)
+ #pragma clang fp contract(off)
+#elif defined(__GNUC__)
+ #pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+ #pragma fp_contract(off)
+#endif
+
+#if JUCE_INTEL && (defined(__GNUC__) || defined(__clang__))
+ #define STENCIL_TARGET(isa) __attribute__((target(isa)))
+#else
+ #define STENCIL_TARGET(isa)
+#endif
+
+StencilKernel::Type StencilKernel::getBestType()
+{
+#if JUCE_INTEL
+    if (SystemStats::hasAVX512F()) return avx512;
+    if (SystemStats::hasAVX2()) return avx2;
+    if (SystemStats::hasSSE2()) return sse2;
+#endif
+    return scalar;
+}
+
+template <typename FloatType>
+typename StencilKernel::Function<FloatType>::Pointer StencilKernel::Function<FloatType>::get(Type type)
+{
+    switch (type)
+    {
+#if JUCE_INTEL
+        case sse2:   return processSSE2;
+        case avx2:   return processAVX2;
+        case avx512: return processAVX512;
+#endif
+        default:     return processScalar;
+    }
+}
+
+template <typename FloatType>
+void StencilKernel::processScalar(FloatType* u0, const FloatType* u1, const FloatType* u2, int N, const FloatType* G)
+{
+    const FloatType G0_0 = G[0], G0_1 = G[1], G0_2 = G[2], G1_0 = G[3], G1_1 = G[4];
+
+    for (int l = 1; l < N; l++)
+    {
+        u0[l] = G0_0 * u1[l] + G0_1 * (u1[l - 1] + u1[l + 1]) + G0_2 * (u1[l - 2] + u1[l + 2])
+            + G1_0 * u2[l] + G1_1 * (u2[l - 1] + u2[l + 1]);
+    }
+}
+
+#if JUCE_INTEL
+STENCIL_TARGET("sse2")
+void StencilKernel::processSSE2(double* u0, const double* u1, const double* u2, int N, const double* G)
+{
+    const __m128d G0_0 = _mm_set1_pd(G[0]), G0_1 = _mm_set1_pd(G[1]), G0_2 = _mm_set1_pd(G[2]);
+    const __m128d G1_0 = _mm_set1_pd(G[3]), G1_1 = _mm_set1_pd(G[4]);
+
+    int l = 1;
+    for (; l + 2 <= N; l += 2)
+    {
+        __m128d sum = _mm_mul_pd(G0_0, _mm_loadu_pd(u1 + l));
+        sum = _mm_add_pd(sum, _mm_mul_pd(G0_1, _mm_add_pd(_mm_loadu_pd(u1 + l - 1), _mm_loadu_pd(u1 + l + 1))));
+        sum = _mm_add_pd(sum, _mm_mul_pd(G0_2, _mm_add_pd(_mm_loadu_pd(u1 + l - 2), _mm_loadu_pd(u1 + l + 2))));
+        sum = _mm_add_pd(sum, _mm_mul_pd(G1_0, _mm_loadu_pd(u2 + l)));
+        sum = _mm_add_pd(sum, _mm_mul_pd(G1_1, _mm_add_pd(_mm_loadu_pd(u2 + l - 1), _mm_loadu_pd(u2 + l + 1))));
+        _mm_store_pd(u0 + l, sum);
+    }
+
+    for (; l < N; l++)
+    {
+        u0[l] = G[0] * u1[l] + G[1] * (u1[l - 1] + u1[l + 1]) + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+    }
+}
+
+STENCIL_TARGET("avx2")
+void StencilKernel::processAVX2(double* u0, const double* u1, const double* u2, int N, const double* G)
+{
+    const __m256d G0_0 = _mm256_set1_pd(G[0]), G0_1 = _mm256_set1_pd(G[1]), G0_2 = _mm256_set1_pd(G[2]);
+    const __m256d G1_0 = _mm256_set1_pd(G[3]), G1_1 = _mm256_set1_pd(G[4]);
+
+    int l = 1;
+    for (; l + 4 <= N; l += 4)
+    {
+        __m256d sum = _mm256_mul_pd(G0_0, _mm256_loadu_pd(u1 + l));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G0_1, _mm256_add_pd(_mm256_loadu_pd(u1 + l - 1), _mm256_loadu_pd(u1 + l + 1))));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G0_2, _mm256_add_pd(_mm256_loadu_pd(u1 + l - 2), _mm256_loadu_pd(u1 + l + 2))));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G1_0, _mm256_loadu_pd(u2 + l)));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G1_1, _mm256_add_pd(_mm256_loadu_pd(u2 + l - 1), _mm256_loadu_pd(u2 + l + 1))));
+        _mm256_store_pd(u0 + l, sum);
+    }
+
+    for (; l < N; l++)
+    {
+        u0[l] = G[0] * u1[l] + G[1] * (u1[l - 1] + u1[l + 1]) + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+    }
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::processAVX512(double* u0, const double* u1, const double* u2, int N, const double* G)
+{
+    const __m512d G0_0 = _mm512_set1_pd(G[0]), G0_1 = _mm512_set1_pd(G[1]), G0_2 = _mm512_set1_pd(G[2]);
+    const __m512d G1_0 = _mm512_set1_pd(G[3]), G1_1 = _mm512_set1_pd(G[4]);
+
+    int l = 1;
+    for (; l + 8 <= N; l += 8)
+    {
+        __m512d sum = _mm512_mul_pd(G0_0, _mm512_loadu_pd(u1 + l));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G0_1, _mm512_add_pd(_mm512_loadu_pd(u1 + l - 1), _mm512_loadu_pd(u1 + l + 1))));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G0_2, _mm512_add_pd(_mm512_loadu_pd(u1 + l - 2), _mm512_loadu_pd(u1 + l + 2))));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G1_0, _mm512_loadu_pd(u2 + l)));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G1_1, _mm512_add_pd(_mm512_loadu_pd(u2 + l - 1), _mm512_loadu_pd(u2 + l + 1))));
+        _mm512_store_pd(u0 + l, sum);
+    }
+
+    for (; l < N; l++)
+    {
+        u0[l] = G[0] * u1[l] + G[1] * (u1[l - 1] + u1[l + 1]) + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+    }
+}
+
+STENCIL_TARGET("sse2")
+void StencilKernel::processSSE2(float* u0, const float* u1, const float* u2, int N, const float* G)
+{
+    const __m128 G0_0 = _mm_set1_ps(G[0]), G0_1 = _mm_set1_ps(G[1]), G0_2 = _mm_set1_ps(G[2]);
+    const __m128 G1_0 = _mm_set1_ps(G[3]), G1_1 = _mm_set1_ps(G[4]);
+
+    int l = 1;
+    for (; l + 4 <= N; l += 4)
+    {
+        __m128 sum = _mm_mul_ps(G0_0, _mm_loadu_ps(u1 + l));
+        sum = _mm_add_ps(sum, _mm_mul_ps(G0_1, _mm_add_ps(_mm_loadu_ps(u1 + l - 1), _mm_loadu_ps(u1 + l + 1))));
+        sum = _mm_add_ps(sum, _mm_mul_ps(G0_2, _mm_add_ps(_mm_loadu_ps(u1 + l - 2), _mm_loadu_ps(u1 + l + 2))));
+        sum = _mm_add_ps(sum, _mm_mul_ps(G1_0, _mm_loadu_ps(u2 + l)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(G1_1, _mm_add_ps(_mm_loadu_ps(u2 + l - 1), _mm_loadu_ps(u2 + l + 1))));
+        _mm_store_ps(u0 + l, sum);
+    }
+
+    for (; l < N; l++)
+    {
+        u0[l] = G[0] * u1[l] + G[1] * (u1[l - 1] + u1[l + 1]) + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+    }
+}
+
+STENCIL_TARGET("avx2")
+void StencilKernel::processAVX2(float* u0, const float* u1, const float* u2, int N, const float* G)
+{
+    const __m256 G0_0 = _mm256_set1_ps(G[0]), G0_1 = _mm256_set1_ps(G[1]), G0_2 = _mm256_set1_ps(G[2]);
+    const __m256 G1_0 = _mm256_set1_ps(G[3]), G1_1 = _mm256_set1_ps(G[4]);
+
+    int l = 1;
+    for (; l + 8 <= N; l += 8)
+    {
+        __m256 sum = _mm256_mul_ps(G0_0, _mm256_loadu_ps(u1 + l));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G0_1, _mm256_add_ps(_mm256_loadu_ps(u1 + l - 1), _mm256_loadu_ps(u1 + l + 1))));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G0_2, _mm256_add_ps(_mm256_loadu_ps(u1 + l - 2), _mm256_loadu_ps(u1 + l + 2))));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G1_0, _mm256_loadu_ps(u2 + l)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G1_1, _mm256_add_ps(_mm256_loadu_ps(u2 + l - 1), _mm256_loadu_ps(u2 + l + 1))));
+        _mm256_store_ps(u0 + l, sum);
+    }
+
+    for (; l < N; l++)
+    {
+        u0[l] = G[0] * u1[l] + G[1] * (u1[l - 1] + u1[l + 1]) + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+    }
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::processAVX512(float* u0, const float* u1, const float* u2, int N, const float* G)
+{
+    const __m512 G0_0 = _mm512_set1_ps(G[0]), G0_1 = _mm512_set1_ps(G[1]), G0_2 = _mm512_set1_ps(G[2]);
+    const __m512 G1_0 = _mm512_set1_ps(G[3]), G1_1 = _mm512_set1_ps(G[4]);
+
+    int l = 1;
+    for (; l + 16 <= N; l += 16)
+    {
+        __m512 sum = _mm512_mul_ps(G0_0, _mm512_loadu_ps(u1 + l));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G0_1, _mm512_add_ps(_mm512_loadu_ps(u1 + l - 1), _mm512_loadu_ps(u1 + l + 1))));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G0_2, _mm512_add_ps(_mm512_loadu_ps(u1 + l - 2), _mm512_loadu_ps(u1 + l + 2))));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G1_0, _mm512_loadu_ps(u2 + l)));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G1_1, _mm512_add_ps(_mm512_loadu_ps(u2 + l - 1), _mm512_loadu_ps(u2 + l + 1))));
+        _mm512_store_ps(u0 + l, sum);
+    }
+
+    for (; l < N; l++)
+    {
+        u0[l] = G[0] * u1[l] + G[1] * (u1[l - 1] + u1[l + 1]) + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+    }
+}
+#endif
+
+template <typename FloatType>
+void StencilKernel::processTensionScalar(FloatType* u0, const FloatType* u1, const FloatType* u2, int N, const FloatType* G, double* sums)
+{
+    double gd = 0.0, gg = 0.0;
+
+    int l = 1;
+    for (; l < N; l++)
+    {
+        const FloatType s1 = u1[l - 1] + u1[l + 1];
+        const FloatType sum = G[0] * u1[l] + G[1] * s1 + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+        u0[l] = sum;
+        const double g = s1 - (u1[l] + u1[l]);
+        gd += g * (sum - u2[l]);
+        gg += g * g;
+    }
+
+    sums[0] = gd;
+    sums[1] = gg;
+}
+
+template <typename FloatType>
+void StencilKernel::correctTensionScalar(FloatType* u0, const FloatType* u1, int N, FloatType c)
+{
+    for (int l = 1; l < N; l++)
+        u0[l] += c * ((u1[l - 1] + u1[l + 1]) - (u1[l] + u1[l]));
+}
+
+#if JUCE_INTEL
+STENCIL_TARGET("avx2")
+void StencilKernel::processTensionAVX2(double* u0, const double* u1, const double* u2, int N, const double* G, double* sums)
+{
+    const __m256d G0_0 = _mm256_set1_pd(G[0]), G0_1 = _mm256_set1_pd(G[1]), G0_2 = _mm256_set1_pd(G[2]);
+    const __m256d G1_0 = _mm256_set1_pd(G[3]), G1_1 = _mm256_set1_pd(G[4]);
+    __m256d gdSum = _mm256_setzero_pd(), ggSum = _mm256_setzero_pd();
+
+    int l = 1;
+    for (; l + 4 <= N; l += 4)
+    {
+        const __m256d centre = _mm256_loadu_pd(u1 + l);
+        const __m256d s1 = _mm256_add_pd(_mm256_loadu_pd(u1 + l - 1), _mm256_loadu_pd(u1 + l + 1));
+        const __m256d previous = _mm256_loadu_pd(u2 + l);
+        __m256d sum = _mm256_mul_pd(G0_0, centre);
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G0_1, s1));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G0_2, _mm256_add_pd(_mm256_loadu_pd(u1 + l - 2), _mm256_loadu_pd(u1 + l + 2))));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G1_0, previous));
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(G1_1, _mm256_add_pd(_mm256_loadu_pd(u2 + l - 1), _mm256_loadu_pd(u2 + l + 1))));
+        _mm256_store_pd(u0 + l, sum);
+
+        const __m256d g = _mm256_sub_pd(s1, _mm256_add_pd(centre, centre));
+        gdSum = _mm256_add_pd(gdSum, _mm256_mul_pd(g, _mm256_sub_pd(sum, previous)));
+        ggSum = _mm256_add_pd(ggSum, _mm256_mul_pd(g, g));
+    }
+
+    alignas (alignment) double lanes[2][4];
+    _mm256_store_pd(lanes[0], gdSum);
+    _mm256_store_pd(lanes[1], ggSum);
+    double gd = 0.0, gg = 0.0;
+    for (int v = 0; v < 4; ++v)
+    {
+        gd += lanes[0][v];
+        gg += lanes[1][v];
+    }
+
+    for (; l < N; l++)
+    {
+        const double s1 = u1[l - 1] + u1[l + 1];
+        const double sum = G[0] * u1[l] + G[1] * s1 + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+        u0[l] = sum;
+        const double g = s1 - (u1[l] + u1[l]);
+        gd += g * (sum - u2[l]);
+        gg += g * g;
+    }
+
+    sums[0] = gd;
+    sums[1] = gg;
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::processTensionAVX512(double* u0, const double* u1, const double* u2, int N, const double* G, double* sums)
+{
+    const __m512d G0_0 = _mm512_set1_pd(G[0]), G0_1 = _mm512_set1_pd(G[1]), G0_2 = _mm512_set1_pd(G[2]);
+    const __m512d G1_0 = _mm512_set1_pd(G[3]), G1_1 = _mm512_set1_pd(G[4]);
+    __m512d gdSum = _mm512_setzero_pd(), ggSum = _mm512_setzero_pd();
+
+    int l = 1;
+    for (; l + 8 <= N; l += 8)
+    {
+        const __m512d centre = _mm512_loadu_pd(u1 + l);
+        const __m512d s1 = _mm512_add_pd(_mm512_loadu_pd(u1 + l - 1), _mm512_loadu_pd(u1 + l + 1));
+        const __m512d previous = _mm512_loadu_pd(u2 + l);
+        __m512d sum = _mm512_mul_pd(G0_0, centre);
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G0_1, s1));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G0_2, _mm512_add_pd(_mm512_loadu_pd(u1 + l - 2), _mm512_loadu_pd(u1 + l + 2))));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G1_0, previous));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G1_1, _mm512_add_pd(_mm512_loadu_pd(u2 + l - 1), _mm512_loadu_pd(u2 + l + 1))));
+        _mm512_store_pd(u0 + l, sum);
+
+        const __m512d g = _mm512_sub_pd(s1, _mm512_add_pd(centre, centre));
+        gdSum = _mm512_add_pd(gdSum, _mm512_mul_pd(g, _mm512_sub_pd(sum, previous)));
+        ggSum = _mm512_add_pd(ggSum, _mm512_mul_pd(g, g));
+    }
+
+    alignas (alignment) double lanes[2][8];
+    _mm512_store_pd(lanes[0], gdSum);
+    _mm512_store_pd(lanes[1], ggSum);
+    double gd = 0.0, gg = 0.0;
+    for (int v = 0; v < 8; ++v)
+    {
+        gd += lanes[0][v];
+        gg += lanes[1][v];
+    }
+
+    for (; l < N; l++)
+    {
+        const double s1 = u1[l - 1] + u1[l + 1];
+        const double sum = G[0] * u1[l] + G[1] * s1 + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+        u0[l] = sum;
+        const double g = s1 - (u1[l] + u1[l]);
+        gd += g * (sum - u2[l]);
+        gg += g * g;
+    }
+
+    sums[0] = gd;
+    sums[1] = gg;
+}
+
+STENCIL_TARGET("avx2")
+void StencilKernel::processTensionAVX2(float* u0, const float* u1, const float* u2, int N, const float* G, double* sums)
+{
+    const __m256 G0_0 = _mm256_set1_ps(G[0]), G0_1 = _mm256_set1_ps(G[1]), G0_2 = _mm256_set1_ps(G[2]);
+    const __m256 G1_0 = _mm256_set1_ps(G[3]), G1_1 = _mm256_set1_ps(G[4]);
+    __m256 gdSum = _mm256_setzero_ps(), ggSum = _mm256_setzero_ps();
+
+    int l = 1;
+    for (; l + 8 <= N; l += 8)
+    {
+        const __m256 centre = _mm256_loadu_ps(u1 + l);
+        const __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(u1 + l - 1), _mm256_loadu_ps(u1 + l + 1));
+        const __m256 previous = _mm256_loadu_ps(u2 + l);
+        __m256 sum = _mm256_mul_ps(G0_0, centre);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G0_1, s1));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G0_2, _mm256_add_ps(_mm256_loadu_ps(u1 + l - 2), _mm256_loadu_ps(u1 + l + 2))));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G1_0, previous));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(G1_1, _mm256_add_ps(_mm256_loadu_ps(u2 + l - 1), _mm256_loadu_ps(u2 + l + 1))));
+        _mm256_store_ps(u0 + l, sum);
+
+        const __m256 g = _mm256_sub_ps(s1, _mm256_add_ps(centre, centre));
+        gdSum = _mm256_add_ps(gdSum, _mm256_mul_ps(g, _mm256_sub_ps(sum, previous)));
+        ggSum = _mm256_add_ps(ggSum, _mm256_mul_ps(g, g));
+    }
+
+    alignas (alignment) float lanes[2][8];
+    _mm256_store_ps(lanes[0], gdSum);
+    _mm256_store_ps(lanes[1], ggSum);
+    double gd = 0.0, gg = 0.0;
+    for (int v = 0; v < 8; ++v)
+    {
+        gd += lanes[0][v];
+        gg += lanes[1][v];
+    }
+
+    for (; l < N; l++)
+    {
+        const float s1 = u1[l - 1] + u1[l + 1];
+        const float sum = G[0] * u1[l] + G[1] * s1 + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+        u0[l] = sum;
+        const double g = s1 - (u1[l] + u1[l]);
+        gd += g * (sum - u2[l]);
+        gg += g * g;
+    }
+
+    sums[0] = gd;
+    sums[1] = gg;
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::processTensionAVX512(float* u0, const float* u1, const float* u2, int N, const float* G, double* sums)
+{
+    const __m512 G0_0 = _mm512_set1_ps(G[0]), G0_1 = _mm512_set1_ps(G[1]), G0_2 = _mm512_set1_ps(G[2]);
+    const __m512 G1_0 = _mm512_set1_ps(G[3]), G1_1 = _mm512_set1_ps(G[4]);
+    __m512 gdSum = _mm512_setzero_ps(), ggSum = _mm512_setzero_ps();
+
+    int l = 1;
+    for (; l + 16 <= N; l += 16)
+    {
+        const __m512 centre = _mm512_loadu_ps(u1 + l);
+        const __m512 s1 = _mm512_add_ps(_mm512_loadu_ps(u1 + l - 1), _mm512_loadu_ps(u1 + l + 1));
+        const __m512 previous = _mm512_loadu_ps(u2 + l);
+        __m512 sum = _mm512_mul_ps(G0_0, centre);
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G0_1, s1));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G0_2, _mm512_add_ps(_mm512_loadu_ps(u1 + l - 2), _mm512_loadu_ps(u1 + l + 2))));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G1_0, previous));
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(G1_1, _mm512_add_ps(_mm512_loadu_ps(u2 + l - 1), _mm512_loadu_ps(u2 + l + 1))));
+        _mm512_store_ps(u0 + l, sum);
+
+        const __m512 g = _mm512_sub_ps(s1, _mm512_add_ps(centre, centre));
+        gdSum = _mm512_add_ps(gdSum, _mm512_mul_ps(g, _mm512_sub_ps(sum, previous)));
+        ggSum = _mm512_add_ps(ggSum, _mm512_mul_ps(g, g));
+    }
+
+    alignas (alignment) float lanes[2][16];
+    _mm512_store_ps(lanes[0], gdSum);
+    _mm512_store_ps(lanes[1], ggSum);
+    double gd = 0.0, gg = 0.0;
+    for (int v = 0; v < 16; ++v)
+    {
+        gd += lanes[0][v];
+        gg += lanes[1][v];
+    }
+
+    for (; l < N; l++)
+    {
+        const float s1 = u1[l - 1] + u1[l + 1];
+        const float sum = G[0] * u1[l] + G[1] * s1 + G[2] * (u1[l - 2] + u1[l + 2])
+            + G[3] * u2[l] + G[4] * (u2[l - 1] + u2[l + 1]);
+        u0[l] = sum;
+        const double g = s1 - (u1[l] + u1[l]);
+        gd += g * (sum - u2[l]);
+        gg += g * g;
+    }
+
+    sums[0] = gd;
+    sums[1] = gg;
+}
+
+STENCIL_TARGET("avx2")
+void StencilKernel::correctTensionAVX2(double* u0, const double* u1, int N, double c)
+{
+    const __m256d C = _mm256_set1_pd(c);
+
+    int l = 1;
+    for (; l + 4 <= N; l += 4)
+    {
+        const __m256d centre = _mm256_loadu_pd(u1 + l);
+        const __m256d g = _mm256_sub_pd(_mm256_add_pd(_mm256_loadu_pd(u1 + l - 1), _mm256_loadu_pd(u1 + l + 1)), _mm256_add_pd(centre, centre));
+        _mm256_store_pd(u0 + l, _mm256_add_pd(_mm256_load_pd(u0 + l), _mm256_mul_pd(C, g)));
+    }
+
+    for (; l < N; l++)
+        u0[l] += c * ((u1[l - 1] + u1[l + 1]) - (u1[l] + u1[l]));
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::correctTensionAVX512(double* u0, const double* u1, int N, double c)
+{
+    const __m512d C = _mm512_set1_pd(c);
+
+    int l = 1;
+    for (; l + 8 <= N; l += 8)
+    {
+        const __m512d centre = _mm512_loadu_pd(u1 + l);
+        const __m512d g = _mm512_sub_pd(_mm512_add_pd(_mm512_loadu_pd(u1 + l - 1), _mm512_loadu_pd(u1 + l + 1)), _mm512_add_pd(centre, centre));
+        _mm512_store_pd(u0 + l, _mm512_add_pd(_mm512_load_pd(u0 + l), _mm512_mul_pd(C, g)));
+    }
+
+    for (; l < N; l++)
+        u0[l] += c * ((u1[l - 1] + u1[l + 1]) - (u1[l] + u1[l]));
+}
+
+STENCIL_TARGET("avx2")
+void StencilKernel::correctTensionAVX2(float* u0, const float* u1, int N, float c)
+{
+    const __m256 C = _mm256_set1_ps(c);
+
+    int l = 1;
+    for (; l + 8 <= N; l += 8)
+    {
+        const __m256 centre = _mm256_loadu_ps(u1 + l);
+        const __m256 g = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(u1 + l - 1), _mm256_loadu_ps(u1 + l + 1)), _mm256_add_ps(centre, centre));
+        _mm256_store_ps(u0 + l, _mm256_add_ps(_mm256_load_ps(u0 + l), _mm256_mul_ps(C, g)));
+    }
+
+    for (; l < N; l++)
+        u0[l] += c * ((u1[l - 1] + u1[l + 1]) - (u1[l] + u1[l]));
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::correctTensionAVX512(float* u0, const float* u1, int N, float c)
+{
+    const __m512 C = _mm512_set1_ps(c);
+
+    int l = 1;
+    for (; l + 16 <= N; l += 16)
+    {
+        const __m512 centre = _mm512_loadu_ps(u1 + l);
+        const __m512 g = _mm512_sub_ps(_mm512_add_ps(_mm512_loadu_ps(u1 + l - 1), _mm512_loadu_ps(u1 + l + 1)), _mm512_add_ps(centre, centre));
+        _mm512_store_ps(u0 + l, _mm512_add_ps(_mm512_load_ps(u0 + l), _mm512_mul_ps(C, g)));
+    }
+
+    for (; l < N; l++)
+        u0[l] += c * ((u1[l - 1] + u1[l + 1]) - (u1[l] + u1[l]));
+}
+#endif
+
+template <typename FloatType>
+typename StencilKernel::TensionFunction<FloatType>::Pointer StencilKernel::TensionFunction<FloatType>::get(Type type)
+{
+    switch (type)
+    {
+#if JUCE_INTEL
+        case avx2:   return processTensionAVX2;
+        case avx512: return processTensionAVX512;
+#endif
+        default:     return processTensionScalar;
+    }
+}
+
+template <typename FloatType>
+typename StencilKernel::CorrectionFunction<FloatType>::Pointer StencilKernel::CorrectionFunction<FloatType>::get(Type type)
+{
+    switch (type)
+    {
+#if JUCE_INTEL
+        case avx2:   return correctTensionAVX2;
+        case avx512: return correctTensionAVX512;
+#endif
+        default:     return correctTensionScalar;
+    }
+}
+
+StencilKernel::LaneFunction StencilKernel::getLaneFunction(Type type)
+{
+    switch (type)
+    {
+#if JUCE_INTEL
+        case avx2:   return processLanesAVX2;
+        case avx512: return processLanesAVX512;
+#endif
+        default:     return processLanesScalar;
+    }
+}
+
+void StencilKernel::processLanesScalar(double* u0, const double* u1, const double* u2, int N, const double* G)
+{
+    const int W = numLanes;
+
+    for (int l = W; l < N * W; l += W)
+    {
+        for (int v = l; v < l + W; ++v)
+        {
+            const double* g = G + (v - l);
+            u0[v] = g[0] * u1[v] + g[W] * (u1[v - W] + u1[v + W]) + g[2 * W] * (u1[v - 2 * W] + u1[v + 2 * W])
+                + g[3 * W] * u2[v] + g[4 * W] * (u2[v - W] + u2[v + W]);
+        }
+    }
+}
+
+#if JUCE_INTEL
+STENCIL_TARGET("avx2")
+void StencilKernel::processLanesAVX2(double* u0, const double* u1, const double* u2, int N, const double* G)
+{
+    const int W = numLanes;
+
+    // Two registers of four lanes per grid point
+    for (int half = 0; half < W; half += 4)
+    {
+        const __m256d G0_0 = _mm256_loadu_pd(G + half), G0_1 = _mm256_loadu_pd(G + W + half);
+        const __m256d G0_2 = _mm256_loadu_pd(G + 2 * W + half), G1_0 = _mm256_loadu_pd(G + 3 * W + half);
+        const __m256d G1_1 = _mm256_loadu_pd(G + 4 * W + half);
+
+        for (int l = W + half; l < N * W; l += W)
+        {
+            __m256d sum = _mm256_mul_pd(G0_0, _mm256_load_pd(u1 + l));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(G0_1, _mm256_add_pd(_mm256_load_pd(u1 + l - W), _mm256_load_pd(u1 + l + W))));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(G0_2, _mm256_add_pd(_mm256_load_pd(u1 + l - 2 * W), _mm256_load_pd(u1 + l + 2 * W))));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(G1_0, _mm256_load_pd(u2 + l)));
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(G1_1, _mm256_add_pd(_mm256_load_pd(u2 + l - W), _mm256_load_pd(u2 + l + W))));
+            _mm256_store_pd(u0 + l, sum);
+        }
+    }
+}
+
+STENCIL_TARGET("avx512f")
+void StencilKernel::processLanesAVX512(double* u0, const double* u1, const double* u2, int N, const double* G)
+{
+    const int W = numLanes;
+    const __m512d G0_0 = _mm512_loadu_pd(G), G0_1 = _mm512_loadu_pd(G + W), G0_2 = _mm512_loadu_pd(G + 2 * W);
+    const __m512d G1_0 = _mm512_loadu_pd(G + 3 * W), G1_1 = _mm512_loadu_pd(G + 4 * W);
+
+    // One register holds grid point l of all eight strings
+    for (int l = W; l < N * W; l += W)
+    {
+        __m512d sum = _mm512_mul_pd(G0_0, _mm512_load_pd(u1 + l));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G0_1, _mm512_add_pd(_mm512_load_pd(u1 + l - W), _mm512_load_pd(u1 + l + W))));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G0_2, _mm512_add_pd(_mm512_load_pd(u1 + l - 2 * W), _mm512_load_pd(u1 + l + 2 * W))));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G1_0, _mm512_load_pd(u2 + l)));
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(G1_1, _mm512_add_pd(_mm512_load_pd(u2 + l - W), _mm512_load_pd(u2 + l + W))));
+        _mm512_store_pd(u0 + l, sum);
+    }
+}
+#endif
+
+template struct StencilKernel::Function<float>;
+template struct StencilKernel::Function<double>;
+template struct StencilKernel::TensionFunction<float>;
+template struct StencilKernel::TensionFunction<double>;
+template struct StencilKernel::CorrectionFunction<float>;
+template struct StencilKernel::CorrectionFunction<double>;
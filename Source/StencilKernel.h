@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    StencilKernel.h
+    Created: 21 Mar 2022 4:40:18pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Interior update of the stiff string scheme for l = 1 .. N - 1. The state rows need one
+// zero guard point on both sides (u[-1] and u[N + 1]), so the boundary points use the same
+// stencil. Coefficients are ordered G0_0, G0_1, G0_2, G1_0, G1_1. Single precision kernels
+// process twice as many points per instruction.
+class StencilKernel
+{
+
+public:
+    enum Type
+    {
+        scalar = 0,
+        sse2,
+        avx2,
+        avx512
+    };
+
+    template <typename FloatType>
+    struct Function
+    {
+        typedef void (*Pointer)(FloatType* u0, const FloatType* u1, const FloatType* u2, int N, const FloatType* G);
+        static Pointer get(Type type);
+    };
+
+    // Tension modulated update in two passes. The first is the linear update that also returns
+    // sums[0] = g . (u0 - u2) and sums[1] = g . g, with g_l = u1[l - 1] - 2 u1[l] + u1[l + 1].
+    // The second adds c g to u0. Every type adds the sums in its own order, and SSE2 uses the
+    // scalar kernels. c needs the complete sums, so the correction can't join the first pass.
+    // Deferring it into the next pass, ahead of the stencil, measured slower than its own pass:
+    // in place the stencil loads what was just stored, in registers it needs shuffles and more
+    // arithmetic than the correction saves. Both passes together cost 1.6 to 2x the linear
+    // kernel, above the 1.3x asked for the tension modulation
+    template <typename FloatType>
+    struct TensionFunction
+    {
+        typedef void (*Pointer)(FloatType* u0, const FloatType* u1, const FloatType* u2, int N, const FloatType* G, double* sums);
+        static Pointer get(Type type);
+    };
+
+    template <typename FloatType>
+    struct CorrectionFunction
+    {
+        typedef void (*Pointer)(FloatType* u0, const FloatType* u1, int N, FloatType c);
+        static Pointer get(Type type);
+    };
+
+    // Interleaved update for a StringBank: numLanes strings per grid point, G holds five rows
+    // of numLanes per-lane coefficients
+    static const int numLanes = 8;
+    typedef void (*LaneFunction)(double* u0, const double* u1, const double* u2, int N, const double* G);
+    static LaneFunction getLaneFunction(Type type);
+
+    static Type getBestType();
+
+    template <typename FloatType>
+    static void processScalar(FloatType* u0, const FloatType* u1, const FloatType* u2, int N, const FloatType* G);
+#if JUCE_INTEL
+    static void processSSE2(double* u0, const double* u1, const double* u2, int N, const double* G);
+    static void processAVX2(double* u0, const double* u1, const double* u2, int N, const double* G);
+    static void processAVX512(double* u0, const double* u1, const double* u2, int N, const double* G);
+    static void processSSE2(float* u0, const float* u1, const float* u2, int N, const float* G);
+    static void processAVX2(float* u0, const float* u1, const float* u2, int N, const float* G);
+    static void processAVX512(float* u0, const float* u1, const float* u2, int N, const float* G);
+#endif
+
+    template <typename FloatType>
+    static void processTensionScalar(FloatType* u0, const FloatType* u1, const FloatType* u2, int N, const FloatType* G, double* sums);
+    template <typename FloatType>
+    static void correctTensionScalar(FloatType* u0, const FloatType* u1, int N, FloatType c);
+#if JUCE_INTEL
+    static void processTensionAVX2(double* u0, const double* u1, const double* u2, int N, const double* G, double* sums);
+    static void processTensionAVX512(double* u0, const double* u1, const double* u2, int N, const double* G, double* sums);
+    static void processTensionAVX2(float* u0, const float* u1, const float* u2, int N, const float* G, double* sums);
+    static void processTensionAVX512(float* u0, const float* u1, const float* u2, int N, const float* G, double* sums);
+    static void correctTensionAVX2(double* u0, const double* u1, int N, double c);
+    static void correctTensionAVX512(double* u0, const double* u1, int N, double c);
+    static void correctTensionAVX2(float* u0, const float* u1, int N, float c);
+    static void correctTensionAVX512(float* u0, const float* u1, int N, float c);
+#endif
+
+    static void processLanesScalar(double* u0, const double* u1, const double* u2, int N, const double* G);
+#if JUCE_INTEL
+    static void processLanesAVX2(double* u0, const double* u1, const double* u2, int N, const double* G);
+    static void processLanesAVX512(double* u0, const double* u1, const double* u2, int N, const double* G);
+#endif
+
+    static const int alignment = 64;    // bytes, state rows start u[1] on this boundary
+};
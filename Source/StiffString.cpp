@@ -11,133 +11,580 @@
 #include "StiffString.h"
 
 
-StiffString::StiffString()
+template <typename FloatType>
+StiffStringT<FloatType>::StiffStringT()
 {
-   
+    grid.theta = 1.0;
+    setKernel(StencilKernel::getBestType());
+    setFs(Fs);
 }
 
-StiffString::~StiffString()
+template <typename FloatType>
+StiffStringT<FloatType>::~StiffStringT()
 {
 
 }
 
-void StiffString::setFs(double Fs)
+template <typename FloatType>
+void StiffStringT<FloatType>::setFs(double Fs)
 {
     this->Fs = Fs;
-    k = 1.0 / Fs; 
+    bowVelocity.reset(Fs, bowRampSeconds);
+    bowPosition.reset(Fs, bowRampSeconds);
 }
 
-void StiffString::setGrid(NamedValueSet& parameters)
+template <typename FloatType>
+int StiffStringT<FloatType>::calculateGridSize(double Fs, double f0, double L, double kappaSq, double sig1)
 {
-    // Get Parameters
-    f0 = *parameters.getVarPointer("f0");
-    L = *parameters.getVarPointer("L");
-    rho = *parameters.getVarPointer("rho");
-    r = *parameters.getVarPointer("r");
-    E = *parameters.getVarPointer("E");
-    sig0 = *parameters.getVarPointer("sig0");
-    sig1 = *parameters.getVarPointer("sig1");
+    return GridCoefficients::calculateGridSize(Fs, f0, L, kappaSq, sig1);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::allocateGrid(int maxN)
+{
+    // Allocate the states once for the largest grid, setGrid only uses the first N + 1 points.
+    // Each row has a zero guard point on both ends and starts u[1] on an aligned boundary
+    this->maxN = maxN;
+    const int perAlignment = StencilKernel::alignment / sizeof(FloatType);
+    const int stride = (maxN + 3 + perAlignment - 1) / perAlignment * perAlignment;
+    uStates = vector<FloatType>(4 * stride + perAlignment + 2, 0);
+
+    size_t address = reinterpret_cast<size_t> (&uStates[2]);
+    int offset = 2 + static_cast<int> ((StencilKernel::alignment - address % StencilKernel::alignment) % StencilKernel::alignment) / sizeof(FloatType);
+
+    u = vector<FloatType*>(3, nullptr);
+    for (int i = 0; i < static_cast<int> (u.size()); ++i)
+        u[i] = ownU[i] = &uStates[offset + i * stride - 1];
+    scratch = &uStates[offset + 3 * stride - 1];
+    implicit.allocate(maxN);
+
+    N = 0;
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::setKernel(StencilKernel::Type type)
+{
+    kernel = StencilKernel::Function<FloatType>::get(type);
+    tensionKernel = StencilKernel::TensionFunction<FloatType>::get(type);
+    tensionCorrection = StencilKernel::CorrectionFunction<FloatType>::get(type);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::setGrid(const StringParams& params)
+{
+    GridCoefficients grid;
+    grid.Fs = Fs;
+    grid.setMaterial(params);
+    grid.calculateGrid(maxN);
+
+    setGrid(grid);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::setGrid(const GridCoefficients& grid)
+{
+    jassert(stride == 1);   // strings leave their StringBank before the grid is rebuilt
+
+    setCoefficients(grid);
+    glideLength = 0;
+
+    // The window only changes with the width, an excitation of another width calculates its own
+    if (excitationWindow.width == 0) excitationWindow.calculate(Spreading::Window::defaultWidth);
+
+    fill(uStates.begin(), uStates.end(), 0.0);
+    psi = 0.0;
+    numEvents = 0;
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::retune(const GridCoefficients& grid)
+{
+    // Swap in the new grid and carry the displacement over, so a sounding string keeps ringing.
+    // Only the preallocated rows are used, which keeps this safe to call from the audio thread
+    jassert(stride == 1);
+
+    const int oldN = N;
+    setCoefficients(grid);
+    glideLength = 0;
+    resampleState(oldN);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::resampleState(int oldN)
+{
+    // The last two states hold oldN + 1 points and are moved onto the current grid
+    FloatType* rows[2] = { u[1], u[2] };
+    for (auto* row : rows)
+    {
+        // Linear interpolation at the same relative position, the boundaries stay at zero
+        copy(row, row + oldN + 1, scratch);
+        fill(row - 1, row + maxN + 2, static_cast<FloatType> (0));
+
+        for (int l = 1; l < N; ++l)
+        {
+            double p = static_cast<double> (l) * oldN / N;
+            int i = static_cast<int> (p);
+            double frac = p - i;
+            row[l] = static_cast<FloatType> ((1.0 - frac) * scratch[i] + frac * scratch[i + 1]);
+        }
+    }
+    fill(u[0] - 1, u[0] + maxN + 2, static_cast<FloatType> (0));
+    resetTension();
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::copyStateFrom(const StiffStringT& other)
+{
+    // Copies into the rows allocated by allocateGrid, other must fit in them
+    jassert(stride == 1 && other.stride == 1 && other.N <= maxN);
+
+    Fs = other.Fs;
+    setCoefficients(other.grid);
+    glideLength = 0;        // the copy fades out on the coefficients it has now
+
+    for (int i = 0; i < 3; ++i)
+    {
+        fill(u[i] - 1, u[i] + maxN + 2, static_cast<FloatType> (0));
+        copy(other.u[i], other.u[i] + N + 1, u[i]);
+    }
+
+    psi = other.psi;
+    bow = other.bow;
+    bow.setBowParams(grid);     // an implicit bow solves its response again on this string
+    pickups = other.pickups;
+    bowed = other.bowed;
+    vb = other.vb;
+    ePos = other.ePos;
+    bowVelocity = other.bowVelocity;
+    bowPosition = other.bowPosition;
+    numEvents = 0;          // pending events belong to the string that keeps playing
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::writeState(MemoryOutputStream& stream)
+{
+    // The last two states in the precision of the scheme, psi and the bow, pending events are left out
+    const bool singlePrecision = sizeof(FloatType) == sizeof(float);
+    stream.writeInt(N);
+    stream.writeBool(singlePrecision);
+    for (int i = 1; i < 3; ++i)
+    {
+        for (int l = 0; l <= N; ++l)
+        {
+            if (singlePrecision) stream.writeFloat(static_cast<float> (u[i][l * stride]));
+            else stream.writeDouble(static_cast<double> (u[i][l * stride]));
+        }
+    }
+
+    stream.writeDouble(psi);
+    stream.writeBool(bowed);
+    stream.writeDouble(vb);
+    stream.writeDouble(bowVelocity.getTargetValue());
+    stream.writeFloat(ePos);
+    stream.writeFloat(bowPosition.getTargetValue());
+    stream.writeDouble(bow.getRelativeVelocity());
+}
+
+template <typename FloatType>
+bool StiffStringT<FloatType>::readState(MemoryInputStream& stream, double timeScale)
+{
+    // Reads a state written by writeState of either precision onto the current grid. A state of
+    // another grid size is resampled like a retune. A grid larger than the rows or a stream too short
+    // for the state is rejected and leaves the string at rest. timeScale is the new time step over
+    // the saved one, the previous state is moved to keep the velocity
+    jassert(stride == 1);
+    fill(uStates.begin(), uStates.end(), static_cast<FloatType> (0));
+    psi = 0.0;
+    bowed = false;
+    numEvents = 0;
+    glideLength = 0;
+
+    const int storedN = stream.readInt();
+    const bool singlePrecision = stream.readBool();
+    if (storedN <= 0 || storedN > maxN) return false;
+
+    const int64 rowBytes = static_cast<int64> (storedN + 1) * (singlePrecision ? sizeof(float) : sizeof(double));
+    const int64 tailBytes = 4 * sizeof(double) + 2 * sizeof(float) + 1;
+    if (stream.getNumBytesRemaining() < 2 * rowBytes + tailBytes) return false;
+
+    for (int i = 1; i < 3; ++i)
+        for (int l = 0; l <= storedN; ++l)
+            u[i][l] = static_cast<FloatType> (singlePrecision ? static_cast<double> (stream.readFloat()) : stream.readDouble());
+
+    psi = stream.readDouble();
+    bowed = stream.readBool();
+    vb = stream.readDouble();
+    bowVelocity.setCurrentAndTargetValue(vb);
+    bowVelocity.setTargetValue(stream.readDouble());
+    ePos = stream.readFloat();
+    bowPosition.setCurrentAndTargetValue(ePos);
+    bowPosition.setTargetValue(stream.readFloat());
+    bow.setRelativeVelocity(stream.readDouble());
+
+    if (timeScale != 1.0)
+        for (int l = 0; l <= storedN; ++l)
+            u[2][l] = static_cast<FloatType> (u[1][l] - timeScale * (u[1][l] - u[2][l]));
+
+    if (storedN != N) resampleState(storedN);
+    else if (timeScale != 1.0) resetTension();
+    return true;
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::setDamping(double sig0)
+{
+    // Only the frequency independent damping changes, so the grid and states are kept
+    GridCoefficients damped = grid;
+    damped.sig0 = sig0;
+    damped.calculateCoefficients();
+    setCoefficients(damped);
+
+    // A running glide keeps its other parameters and ends on this damping
+    for (auto* end : { &glideFrom, &glideTarget })
+    {
+        end->sig0 = sig0;
+        end->calculateCoefficients();
+    }
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::glideTo(const GridCoefficients& target)
+{
+    // Parameter changes that keep the grid move the coefficients over a few blocks instead of
+    // rebuilding the string, the state is kept as it is
+    jassert(canGlideTo(target));
+    glideFrom = grid;
+    glideTarget = target;
+    glidePosition = 0;
+    glideLength = jmax(1, roundToInt(glideSeconds * Fs));
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::advanceGlide(int numSamples)
+{
+    // One step per block, at the fraction of the glide the block ends on
+    if (glideLength == 0)
+        return;
+
+    glidePosition = jmin(glidePosition + numSamples, glideLength);
+    const double oldScale = grid.psiScale;
+    if (glidePosition < glideLength)
+    {
+        setCoefficients(GridCoefficients::interpolate(glideFrom, glideTarget, static_cast<double> (glidePosition) / glideLength));
+    }
+    else
+    {
+        setCoefficients(glideTarget);
+        glideLength = 0;
+    }
+
+    // psi is the stretch scaled by psiScale, so it follows a change of scale
+    if (grid.isNonlinear())
+        psi *= grid.psiScale / oldScale;
+}
 
-    A = r * r * double_Pi;
-    I = r * r * r * r * double_Pi * 0.25;
-    c = f0 * 2.0 * L;
+template <typename FloatType>
+void StiffStringT<FloatType>::setCoefficients(const GridCoefficients& grid)
+{
+    // A plain copy, the grid and Stencil factors are calculated up front
+    jassert(grid.N <= maxN);
+    this->grid = grid;
+    N = grid.N;
 
-    // Create Grid:
-    kappaSq = E * I / (rho * A);
-    double stabTmp = c * c * k * k + 4.0 * sig1 * k;
-    h = sqrt(0.5 * (stabTmp + sqrt((stabTmp * stabTmp) + 16.0 * kappaSq * k * k)));
-    N = floor(L / h);
-    h = L / N;
+    if (grid.isImplicit())
+    {
+        // The kernel calculates the right hand side of the implicit scheme
+        G[0] = static_cast<FloatType> (grid.T1_0); G[1] = static_cast<FloatType> (grid.T1_1); G[2] = static_cast<FloatType> (grid.T1_2);
+        G[3] = static_cast<FloatType> (grid.T2_0); G[4] = static_cast<FloatType> (grid.T2_1);
+        implicit.setCoefficients(grid);
+    }
+    else
+    {
+        G[0] = static_cast<FloatType> (grid.G0_0); G[1] = static_cast<FloatType> (grid.G0_1); G[2] = static_cast<FloatType> (grid.G0_2);
+        G[3] = static_cast<FloatType> (grid.G1_0); G[4] = static_cast<FloatType> (grid.G1_1);
+    }
 
-    uStates.clear();
-    uStates = vector<vector<double>>(3, vector<double>(N + 1, 0));
+    bow.setBowParams(grid);
+    pickups.calculateTaps(N, eScalar);
+}
 
-    u.clear();
-    u = vector<double*>(3, nullptr);
+template <typename FloatType>
+void StiffStringT<FloatType>::setPickups(const Pickups& pickups)
+{
+    this->pickups = pickups;
+    this->pickups.calculateTaps(N, eScalar);
+}
 
-    for (int i = 0; i < u.size(); ++i)
-        u[i] = &uStates[i][0];
+template <typename FloatType>
+void StiffStringT<FloatType>::renderBlock(float* outL, float* outR, int numSamples)
+{
+    // Render up to each pending event, so excitations and bow changes land on their exact sample.
+    // Without outR both channels are mixed into outL
+    int n = 0;
+    while (n < numSamples)
+    {
+        int end = applyEvents(n, numSamples);
+        renderSamples(outL + n, outR != nullptr ? outR + n : nullptr, end - n);
+        n = end;
+    }
 
-    // Calculate Stencil factors:
-    lambdaSq = k * k * c * c / (h * h);
-    S0 = sig0 * k;                              // freq ind damping factor
-    S1 = 2 * k * sig1 / (h * h);                // freq dep damping factor
-    K = -kappaSq * k * k / (h * h * h * h);     // stiffness factor
-    D = 1 / (1 + S0);                           // fraction due to freq. indep. damping term
+    endBlock(numSamples);
+}
 
-    G0_0 = (2 -2 * lambdaSq + 6 * K - 2 * S1) * D;      // u_l^ n
-    G0_1 = (lambdaSq - 4 * K + S1) * D;                 // u_l -/+1 ^ n
-    G0_2 = K * D;                                       // u_l -/+2 ^ n
-    G1_0 = (-1 + S0 + 2 * S1) * D;                      // u_l^ n - 1
-    G1_1 = -S1 * D;                                     // u_l -/+1 ^ n - 1
+template <typename FloatType>
+int StiffStringT<FloatType>::applyEvents(int n, int numSamples)
+{
+    // Applies the events due at sample n and returns where the next one is due
+    int e = 0;
+    while (e < numEvents && events[e].offset <= n)
+        applyEvent(events[e++]);
 
-    // Add bow parameters
-    bowParameters = parameters; 
-    bowParameters.set("kappaSq", kappaSq);
-    bowParameters.set("cSq", c * c);
-    bowParameters.set("h", h);
-    bowParameters.set("k", k);
-    bowParameters.set("N", N);
+    for (int i = e; i < numEvents; ++i)
+        events[i - e] = events[i];
+    numEvents -= e;
 
-    bow.setBowParams(bowParameters);
+    return (numEvents > 0 && events[0].offset < numSamples) ? events[0].offset : numSamples;
 }
 
-double StiffString::getNextSample(float outputPos)
+template <typename FloatType>
+void StiffStringT<FloatType>::endBlock(int numSamples)
 {
-    calculateScheme();
+    for (int i = 0; i < numEvents; ++i)
+        events[i].offset -= numSamples;
+
+    advanceGlide(numSamples);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::renderSamples(float* outL, float* outR, int numSamples)
+{
+    // Keep the state pointers in registers for the whole block
+    FloatType* u0 = u[0];
+    FloatType* u1 = u[1];
+    FloatType* u2 = u[2];
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        calculateScheme(u0, u1, u2);
 
-    double out = u[0][static_cast<int> (round(outputPos * N))];
-    out = out * eScalar;  // scale to make excitaiton audible 
-    updateStates();
+        // Bow string
+        if (bowed)
+        {
+            advanceBow();
+            if (grid.isImplicit()) bow.setExcitation(u0, u2, implicit, ePos, vb);
+            else if (grid.isNonlinear())
+            {
+                // The bow reads the update with the tension, and psi follows the points it moves
+                bow.setExcitation(u0, u2, ePos, vb);
+                const FloatType* v1 = u1 + bow.getSpreadStart();
+                const double* w = bow.getSpreadWeights();
+                double work = 0.0;
+                for (int j = 0; j < 4; ++j)
+                    work += w[j] * (v1[j - 1] - 2.0 * v1[j] + v1[j + 1]);
+                psi -= 0.5 * grid.psiGradient * bow.getSpreadDisplacement() * work;
+            }
+            else bow.setExcitation(u0, u1, u2, 1, ePos, vb);
+        }
+
+        // The pickup weights include eScalar, which makes the excitation audible
+        float left, right;
+        pickups.gather(u0, 1, left, right);
+        if (outR != nullptr)
+        {
+            outL[n] = left;
+            outR[n] = right;
+        }
+        else outL[n] = 0.5f * (left + right);
 
-    return out; 
+        // Pointer switch
+        FloatType* uTmp = u2;
+        u2 = u1;
+        u1 = u0;
+        u0 = uTmp;
+    }
+
+    u[0] = u0;
+    u[1] = u1;
+    u[2] = u2;
 }
 
-void StiffString::calculateScheme()
+template <typename FloatType>
+void StiffStringT<FloatType>::calculateScheme(FloatType* u0, const FloatType* u1, const FloatType* u2)
 {
-    for (int l = 2; l < N - 1; l++)
+    // The guard points are zero, so the simply supported boundaries use the interior stencil
+    if (grid.isNonlinear())
     {
-        u[0][l] = G0_0 * u[1][l] + G0_1 * (u[1][l - 1] + u[1][l + 1]) + G0_2 * (u[1][l - 2] + u[1][l + 2]) 
-            + G1_0 * u[2][l] + G1_1 * (u[2][l - 1] + u[2][l + 1]);
+        calculateTension(u0, u1, u2);
+        return;
     }
 
-    // Simply supported boundery condition: 
-    u[0][1] = G0_0 * u[1][1] + G0_1 * (u[1][2]) + G0_2 * (u[1][3])
-        + G1_0 * u[2][1] + G1_1 * (u[2][2]);
-    u[0][N - 1] = G0_0 * u[1][N - 1] + G0_1 * (u[1][N - 2]) + G0_2 * (u[1][N - 3])
-        + G1_0 * u[2][N - 1] + G1_1 * (u[2][N - 2]);
+    kernel(u0, u1, u2, N, G);
+    if (grid.isImplicit()) implicit.process(u0, u2);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::calculateTension(FloatType* u0, const FloatType* u1, const FloatType* u2)
+{
+    // Kirchhoff-Carrier tension with psi as a scalar auxiliary variable. The tension pushes with
+    // -mu(psi) along g = dxx u^n, and psi moves by psiGradient * g . (u^n+1 - u^n-1) / 2. That is linear
+    // in u^n+1 and only needs g . u^n+1, so the sums of the linear pass give mu(psi) directly
+    // (Sherman-Morrison on a rank one update) and psi needs no pass of its own. psi^2 / 2 is the
+    // energy of the tension, which the update conserves exactly
+    double sums[2];
+    tensionKernel(u0, u1, u2, N, G, sums);
 
-    // Bow string
-    if(bowed)bow.setExcitation(u, ePos, vb);
+    const double quarterGradient = 0.25 * grid.psiGradient;
+    const double muPsi = (psi + quarterGradient * sums[0]) / (1.0 + quarterGradient * grid.psiGain * sums[1]);
+    tensionCorrection(u0, u1, N, static_cast<FloatType> (-grid.psiGain * muPsi));
+    psi = 2.0 * muPsi - psi;
 }
 
-void StiffString::updateStates()
+template <typename FloatType>
+void StiffStringT<FloatType>::resetTension()
 {
-    // Pointer switch
-    double* uTmp = u[2];
-    u[2] = u[1];
-    u[1] = u[0];
-    u[0] = uTmp;
+    // psi from the last two states, after something other than the scheme set them
+    if (!grid.isNonlinear())
+    {
+        psi = 0.0;
+        return;
+    }
+
+    const FloatType* u1 = u[1];
+    const FloatType* u2 = u[2];
+    const int s = stride;
+    double sum = 0.0;
+    for (int l = 0; l < N * s; l += s)
+    {
+        double d1 = u1[l + s] - u1[l];
+        double d2 = u2[l + s] - u2[l];
+        sum += 0.5 * (d1 * d1 + d2 * d2);
+    }
+    psi = grid.psiScale * sum / grid.h;
 }
 
-void StiffString::exciteSystem(double amp, float pos, int width, bool strike)
+template <typename FloatType>
+void StiffStringT<FloatType>::queueExcitation(int offset, double amp, float pos, int width, bool strike)
+{
+    Event event = { offset, false, amp, pos, width, strike, false, 0.0 };
+    queueEvent(event);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::queueBow(int offset, bool bowed, double vb, float pos)
+{
+    Event event = { offset, true, 0.0, pos, 0, false, bowed, vb };
+    queueEvent(event);
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::queueEvent(Event& event)
+{
+    if (event.offset <= 0 || numEvents == maxEvents)
+    {
+        applyEvent(event);
+        return;
+    }
+
+    // Insert sorted, events with the same offset keep their order
+    int i = numEvents;
+    while (i > 0 && events[i - 1].offset > event.offset)
+    {
+        events[i] = events[i - 1];
+        --i;
+    }
+    events[i] = event;
+    ++numEvents;
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::applyEvent(Event& event)
+{
+    if (event.isBow)
+    {
+        // A new stroke starts from rest at its position, a running stroke glides to the new values
+        if (event.bowed && !bowed)
+        {
+            bowVelocity.setCurrentAndTargetValue(0.0);
+            bowPosition.setCurrentAndTargetValue(event.pos);
+        }
+        bowed = event.bowed;
+        bowVelocity.setTargetValue(event.vb);
+        bowPosition.setTargetValue(event.pos);
+    }
+    else
+    {
+        exciteSystem(event.amp, event.pos, event.width, event.strike);
+    }
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::exciteSystem(double amp, float pos, int width, bool strike)
 {
     //// Excitation using a Hann window/ raised cosine ////
     
     if (strike) amp *= 1.0 / (width * 0.7); // prevent distortion of sound when striking
     if (amp > 1.0) amp = 1.0; 
+    if (width != excitationWindow.width) excitationWindow.calculate(width);
 
-    int startPos = floor(pos * N - width * 0.5);
-    if (startPos < 1) startPos = 1;
-    for (int w = startPos; w < startPos + width; w++)
+    Spreading::forExcitation(excitationWindow, pos, N, [&](int l, double window)
     {
-        if (w > (N - 2)) break;
-        else
-        {
-            u[2][w] = 0.5 * amp * (1 - cos((2 * double_Pi * (w - startPos)) / width)) / eScalar;
-            if (!strike)
-                u[1][w] = u[2][w];
-            ;
-        }
+        u[2][l * stride] = static_cast<FloatType> (amp * window / eScalar);
+        if (!strike)
+            u[1][l * stride] = u[2][l * stride];
+    });
+
+    resetTension();
+}
+
+template <typename FloatType>
+void StiffStringT<FloatType>::clearState()
+{
+    // Zeroes the grid of a string that has decayed, the coefficients are kept for the next excitation
+    jassert(stride == 1);
+
+    fill(uStates.begin(), uStates.end(), static_cast<FloatType> (0));
+    psi = 0.0;
+    bowed = false;
+    vb = 0.0;
+}
+
+template <typename FloatType>
+double StiffStringT<FloatType>::getEnergy()
+{
+    // Discrete Hamiltonian of the scheme between the last two states, which is non-increasing
+    // under the stability condition: kinetic + potential - frequency dependent damping term.
+    // The implicit scheme splits the potential over theta and (1 - theta) / 2 of both states
+    // and has no damping term, its damping is centered in time. The tension modulation adds psi^2 / 2
+    const FloatType* u1 = u[1];
+    const FloatType* u2 = u[2];
+    const int s = stride;
+    const double theta = grid.isImplicit() ? grid.theta : 1.0;
+    const double mu = 0.5 * (1.0 - theta);
+
+    auto potential = [&](const FloatType* a, const FloatType* b, int l)
+    {
+        double dxx = 2.0 * b[l] - b[l - s] - b[l + s];
+        double dxxxx = b[l - 2 * s] - 4.0 * b[l - s] + 6.0 * b[l] - 4.0 * b[l + s] + b[l + 2 * s];
+        return a[l] * (grid.lambdaSq * dxx - grid.K * dxxxx);
+    };
+
+    double kinetic = 0.0, mixed = 0.0, own = 0.0, damping = 0.0;
+    for (int l = s; l < N * s; l += s)
+    {
+        double a = u1[l] - u2[l];
+        double aPrev = u1[l - s] - u2[l - s];
+        double aNext = u1[l + s] - u2[l + s];
+
+        kinetic += a * a;
+        mixed += potential(u1, u2, l);
+        if (mu > 0.0) own += potential(u1, u1, l) + potential(u2, u2, l);
+        damping += a * (2.0 * a - aPrev - aNext);
     }
-}
\ No newline at end of file
+
+    if (grid.isImplicit()) damping = 0.0;
+    return grid.rho * grid.A * grid.h / (2.0 * grid.k * grid.k) * (kinetic + theta * mixed + mu * own - 0.5 * grid.S1 * damping)
+        + 0.5 * psi * psi;
+}
+
+template class StiffStringT<float>;
+template class StiffStringT<double>;
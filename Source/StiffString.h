@@ -12,41 +12,124 @@
 #include <cmath>
 #include <vector>
 #include "Bow.h"
+#include "StencilKernel.h"
+#include "CoefficientCache.h"
+#include "Pickups.h"
+#include "Spreading.h"
+#include "ImplicitScheme.h"
 
 using namespace std;
 
 #pragma once
 
-class StiffString
+class StringBank;
+class ModalString;
+class StringNetwork;
+
+template <typename FloatType>
+class StiffStringT
 {
+    friend class StringBank;
+    friend class ModalString;
+    friend class StringNetwork;
 
 public:
-    StiffString();      // Constructor
-    ~StiffString();     // Destructor
+    StiffStringT();      // Constructor
+    ~StiffStringT();     // Destructor
     
     void setFs(double Fs);
-    void setGrid(NamedValueSet& parameters);
-    double getNextSample(float outputPos);
+    void allocateGrid(int maxN);
+    void setGrid(const StringParams& params);
+    void setGrid(const GridCoefficients& grid);
+    void retune(const GridCoefficients& grid);
+    void copyStateFrom(const StiffStringT& other);
+    void writeState(MemoryOutputStream& stream);
+    bool readState(MemoryInputStream& stream, double timeScale);
+    void setDamping(double sig0);
+    bool canGlideTo(const GridCoefficients& target) const { return GridCoefficients::canInterpolate(grid, target); };
+    void glideTo(const GridCoefficients& target);
+    bool isGliding() const { return glideLength > 0; };
+    int getGridSize() { return N; };
+    void setKernel(StencilKernel::Type type);
+    void renderBlock(float* outL, float* outR, int numSamples);
+    void setPickups(const Pickups& pickups);
     void exciteSystem(double amp, float pos, int width, bool strike);
+    void queueExcitation(int offset, double amp, float pos, int width, bool strike);
+    void queueBow(int offset, bool bowed, double vb, float pos);
+    double getEnergy();
+    void clearState();
+    bool hasPendingEvents() { return numEvents > 0; };
+    bool isBowMoving() const { return bowed && (vb != 0.0 || bowVelocity.getTargetValue() != 0.0); };  // a resting bow lets the string decay
+    bool matchesBow(bool bowed, double vb, float pos) const { return numEvents == 0 && this->bowed == bowed && (!bowed || (bowVelocity.getTargetValue() == vb && bowPosition.getTargetValue() == pos)); };
+    bool isImplicit() const { return grid.isImplicit(); };
+    bool isNonlinear() const { return grid.isNonlinear(); };
+    void setFriction(FrictionModel::Law law, double a, FrictionModel::Mode mode) { bow.setFriction(law, a); bow.setFrictionMode(mode); };
+    const Bow::SolverStats& getBowStats() const { return bow.getSolverStats(); };
+    void resetBowStats() { bow.resetSolverStats(); };
    
     double Fs = 48000.0;
 
     float ePos;
     bool bowed = false; 
     double vb = 0; // bow velocity
+
+    static int calculateGridSize(double Fs, double f0, double L, double kappaSq, double sig1);
+    static const int maxGridSize = 4096;                                    // hard limit on the grid size
+    static constexpr double bowRampSeconds = 0.01;                          // bow velocity and position glide to new values
+    static constexpr double glideSeconds = 0.02;                            // coefficient changes on the same grid glide this long
 private:
-    void calculateScheme();
-    void updateStates();
+    struct Event
+    {
+        int offset;                                                         // sample in the next rendered block
+        bool isBow;
+        double amp; float pos; int width; bool strike;                      // linear excitation
+        bool bowed; double vb;                                              // bow
+    };
+
+    void renderSamples(float* outL, float* outR, int numSamples);
+    void calculateScheme(FloatType* u0, const FloatType* u1, const FloatType* u2);
+    void calculateTension(FloatType* u0, const FloatType* u1, const FloatType* u2);
+    void resetTension();
+    void resampleState(int oldN);
+    void setCoefficients(const GridCoefficients& grid);
+    void queueEvent(Event& event);
+    void applyEvent(Event& event);
+    int applyEvents(int n, int numSamples);
+    void advanceBow() { vb = bowVelocity.getNextValue(); ePos = bowPosition.getNextValue(); };
+    void endBlock(int numSamples);
+    void advanceGlide(int numSamples);
    
-    double h, k, L, c, f0, r, A, I, E, rho, sig0, sig1, kappaSq, lambdaSq;  // parameters
-    double S0, S1, K, D, G0_0, G0_1, G0_2, G1_0, G1_1;                      // Stencil factors
+    GridCoefficients grid {};                                               // parameters and Stencil factors
+    FloatType G[5];                                                         // Stencil factors in kernel order
     int N;                                                                  // grid size
+    int maxN = 0;                                                           // allocated grid size
 
-    vector<vector<double>> uStates;                                         // vector containing the grid states
-    vector<double*> u;                                                      // vector with pointers to the grid states
+    vector<FloatType> uStates;                                              // aligned and padded grid states
+    vector<FloatType*> u;                                                   // vector with pointers to the grid states
+    FloatType* ownU[3];                                                     // own rows, u points elsewhere inside a StringBank
+    FloatType* scratch = nullptr;                                           // spare row used when the grid is resampled
+    int stride = 1;                                                         // distance between grid points in u
+    typename StencilKernel::Function<FloatType>::Pointer kernel = nullptr;
+    ImplicitScheme implicit;                                                // used instead of the kernel when theta < 1
+    typename StencilKernel::TensionFunction<FloatType>::Pointer tensionKernel = nullptr;
+    typename StencilKernel::CorrectionFunction<FloatType>::Pointer tensionCorrection = nullptr;
+    double psi = 0.0;                                                       // tension modulation, square root of twice its energy at n + 1/2
    
-    NamedValueSet bowParameters;
     Bow bow;
+    Spreading::Window excitationWindow;                                     // raised cosine of the last excitation width
+    Pickups pickups;                                                        // output taps, calculated with the grid
+    SmoothedValue<double> bowVelocity;                                      // ramps vb towards the last bow event
+    SmoothedValue<float> bowPosition;                                       // ramps ePos towards the last bow event
 
     double eScalar = 500.0;                                                 // scalar for linear excitation
-};
\ No newline at end of file
+
+    GridCoefficients glideFrom {}, glideTarget {};                          // ends of a coefficient glide on the same grid
+    int glidePosition = 0, glideLength = 0;                                 // in samples, no glide while the length is 0
+
+    static const int maxEvents = 32;
+    Event events[maxEvents];                                                // pending events, sorted by offset
+    int numEvents = 0;
+};
+
+typedef StiffStringT<double> StiffString;      // double precision scheme
+typedef StiffStringT<float> StiffStringFloat;  // single precision state and stencil, double precision bow
\ No newline at end of file
@@ -0,0 +1,209 @@
+/*
+  ==============================================================================
+
+    StringBank.cpp
+    Created: 4 Apr 2022 3:21:09pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "StringBank.h"
+
+StringBank::StringBank()
+{
+    kernel = StencilKernel::getLaneFunction(StencilKernel::getBestType());
+
+    for (int v = 0; v < numLanes; ++v)
+    {
+        strings[v] = nullptr;
+        laneN[v] = 0;
+        outputs[v][0] = outputs[v][1] = nullptr;
+    }
+}
+
+StringBank::~StringBank()
+{
+
+}
+
+void StringBank::allocate(int maxN)
+{
+    // Rows hold grid points -1 .. maxN + 1 and start on a cache line
+    this->maxN = maxN;
+    const int rowSize = (maxN + 3) * numLanes;
+    const int perAlignment = StencilKernel::alignment / sizeof(double);
+    uStates = vector<double>(3 * rowSize + perAlignment, 0);
+
+    size_t address = reinterpret_cast<size_t> (uStates.data());
+    int offset = static_cast<int> ((StencilKernel::alignment - address % StencilKernel::alignment) % StencilKernel::alignment) / sizeof(double);
+
+    for (int i = 0; i < 3; ++i)
+        u[i] = &uStates[offset + i * rowSize + numLanes];   // u[i] points at grid point 0
+
+    N = 0;
+    numStrings = 0;
+    gatherCoefficients();
+}
+
+bool StringBank::canHold(int stringN)
+{
+    // The extra points of the shorter strings are wasted work, so only close grid sizes share a bank
+    if (numStrings == 0) return stringN <= maxN;
+    if (isFull()) return false;
+
+    int lo = stringN, hi = stringN;
+    for (int v = 0; v < numLanes; ++v)
+    {
+        if (strings[v] == nullptr) continue;
+        lo = jmin(lo, laneN[v]);
+        hi = jmax(hi, laneN[v]);
+    }
+    return hi <= maxN && areClose(lo, hi);
+}
+
+bool StringBank::addString(StiffString& string, float* outL, float* outR)
+{
+    if (string.stride != 1 || string.isImplicit() || string.isNonlinear() || !canHold(string.N)) return false;
+
+    if (numStrings == 0)
+    {
+        N = 0;
+        fill(uStates.begin(), uStates.end(), 0.0);
+    }
+
+    // Interleave the current state of the string into its lane. Points past its end are still
+    // zero, also when a longer string grows the bank
+    int lane = 0;
+    while (strings[lane] != nullptr) ++lane;
+
+    for (int i = 0; i < 3; ++i)
+        for (int l = 0; l <= string.N; ++l)
+            u[i][l * numLanes + lane] = string.u[i][l];
+
+    N = jmax(N, string.N);
+    laneN[lane] = string.N;
+    strings[lane] = &string;
+    outputs[lane][0] = outL;
+    outputs[lane][1] = outR;
+    ++numStrings;
+    attach(lane);
+    gatherCoefficients();
+
+    return true;
+}
+
+void StringBank::removeString(StiffString& string)
+{
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        if (strings[lane] != &string) continue;
+
+        // Copy the lane back into the string's own rows, keeping the current time order
+        for (int i = 0; i < 3; ++i)
+        {
+            string.u[i] = string.ownU[i];
+            for (int l = 0; l <= string.N; ++l)
+            {
+                string.u[i][l] = u[i][l * numLanes + lane];
+                u[i][l * numLanes + lane] = 0.0;
+            }
+        }
+        string.stride = 1;
+
+        strings[lane] = nullptr;
+        laneN[lane] = 0;
+        outputs[lane][0] = outputs[lane][1] = nullptr;
+        --numStrings;
+        gatherCoefficients();
+
+        // Shrink to the longest string left, the rows past it are zero in every lane
+        N = 0;
+        for (int v = 0; v < numLanes; ++v)
+            N = jmax(N, laneN[v]);
+        return;
+    }
+}
+
+void StringBank::renderBlock(int numSamples)
+{
+    gatherCoefficients();
+
+    // Split the block at the first pending event of any lane
+    int n = 0;
+    while (n < numSamples)
+    {
+        int end = numSamples;
+        for (int v = 0; v < numLanes; ++v)
+            if (strings[v] != nullptr)
+                end = jmin(end, strings[v]->applyEvents(n, numSamples));
+
+        renderSamples(n, end - n);
+        n = end;
+    }
+
+    for (int v = 0; v < numLanes; ++v)
+        if (strings[v] != nullptr)
+            strings[v]->endBlock(numSamples);
+}
+
+void StringBank::renderSamples(int offset, int numSamples)
+{
+    double* u0 = u[0];
+    double* u1 = u[1];
+    double* u2 = u[2];
+    const int W = numLanes;
+
+    for (int n = 0; n < numSamples; ++n)
+    {
+        // Same operation order as StencilKernel::processScalar, one lane per string
+        kernel(u0, u1, u2, N, G);
+
+        for (int v = 0; v < W; ++v)
+        {
+            StiffString* string = strings[v];
+            if (string == nullptr) continue;
+
+            // A shorter string ends at its own boundary
+            for (int l = laneN[v]; l < N; ++l)
+                u0[l * W + v] = 0.0;
+
+            if (string->bowed)
+            {
+                string->advanceBow();
+                string->bow.setExcitation(u0 + v, u1 + v, u2 + v, W, string->ePos, string->vb);
+            }
+            string->pickups.gather(u0 + v, W, outputs[v][0][offset + n], outputs[v][1][offset + n]);
+        }
+
+        // Pointer switch
+        double* uTmp = u2;
+        u2 = u1;
+        u1 = u0;
+        u0 = uTmp;
+    }
+
+    u[0] = u0;
+    u[1] = u1;
+    u[2] = u2;
+
+    for (int v = 0; v < W; ++v)
+        if (strings[v] != nullptr)
+            attach(v);
+}
+
+void StringBank::gatherCoefficients()
+{
+    // Read every block, so damping changes and coefficient glides on a string reach its lane
+    for (int v = 0; v < numLanes; ++v)
+        for (int i = 0; i < 5; ++i)
+            G[i * numLanes + v] = strings[v] != nullptr ? strings[v]->G[i] : 0.0;
+}
+
+void StringBank::attach(int lane)
+{
+    // Point the string into its lane, so excitations and the energy read the shared state
+    for (int i = 0; i < 3; ++i)
+        strings[lane]->u[i] = u[i] + lane;
+    strings[lane]->stride = numLanes;
+}
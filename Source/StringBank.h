@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    StringBank.h
+    Created: 4 Apr 2022 3:21:09pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StiffString.h"
+
+// Shared state arena for up to numLanes double precision strings with nearly the same grid size.
+// Grid point l of every string is stored next to each other, so one pass over the grid
+// updates all strings in lockstep, one SIMD lane per string. The bank runs over the largest
+// grid, a shorter string keeps its points past its own end at zero.
+class StringBank
+{
+
+public:
+    StringBank();      // Constructor
+    ~StringBank();     // Destructor
+
+    void allocate(int maxN);
+    bool addString(StiffString& string, float* outL, float* outR);
+    void removeString(StiffString& string);
+    void renderBlock(int numSamples);
+
+    int getNumStrings() { return numStrings; };
+    int getGridSize() { return N; };
+    bool isFull() { return numStrings == numLanes; };
+    bool canHold(int stringN);
+    static bool areClose(int lo, int hi) { return hi - lo <= hi / bucketFraction; };
+
+    static const int numLanes = StencilKernel::numLanes;
+    static const int minStrings = 6;        // below this, the strings render faster on their own
+    static const int bucketFraction = 16;   // grid sizes in a bank differ by at most 1/16th of the largest
+
+private:
+    void renderSamples(int offset, int numSamples);
+    void gatherCoefficients();
+    void attach(int lane);
+
+    vector<double> uStates;                                 // interleaved rows, numLanes values per grid point
+    double* u[3];
+    int N = 0;
+    int maxN = 0;
+
+    StiffString* strings[numLanes];
+    int laneN[numLanes];                                    // grid size of the string in every lane
+    float* outputs[numLanes][2];                            // left and right block of every lane
+    int numStrings = 0;
+
+    double G[5 * numLanes];                                 // stencil factors per lane, zero for empty lanes
+    StencilKernel::LaneFunction kernel;
+};
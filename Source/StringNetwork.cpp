@@ -0,0 +1,407 @@
+/*
+  ==============================================================================
+
+    StringNetwork.cpp
+    Created: 27 Jun 2022 2:18:44pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "StringNetwork.h"
+
+StringNetwork::StringNetwork()
+{
+
+}
+
+StringNetwork::~StringNetwork()
+{
+
+}
+
+void StringNetwork::prepare(double Fs, int maxN)
+{
+    // Allocates every string for the largest grid, adding strings and connections later doesn't allocate
+    this->Fs = Fs;
+    this->maxN = maxN;
+    k = 1.0 / Fs;
+
+    strings.clear();
+    for (int s = 0; s < maxStrings; ++s)
+    {
+        auto* string = strings.add(new StiffString());
+        string->setFs(Fs);
+        string->allocateGrid(maxN);
+    }
+
+    clear();
+}
+
+void StringNetwork::clear()
+{
+    numStrings = 0;
+    numConnections = 0;
+    nonlinear = false;
+    bridgeMass = 0.0;
+    x[0] = x[1] = x[2] = 0.0;
+}
+
+int StringNetwork::addString(const GridCoefficients& grid)
+{
+    if (numStrings == maxStrings) return -1;
+
+    strings[numStrings]->setGrid(toExplicit(grid, maxN));
+    return numStrings++;
+}
+
+void StringNetwork::retuneString(int s, const GridCoefficients& grid)
+{
+    // A string keeps ringing: the same grid size glides to the new coefficients, another one is resampled
+    jassert(s >= 0 && s < numStrings);
+    const GridCoefficients explicitGrid = toExplicit(grid, maxN);
+    StiffString& string = *strings[s];
+
+    if (string.canGlideTo(explicitGrid)) string.glideTo(explicitGrid);
+    else string.retune(explicitGrid);
+}
+
+GridCoefficients StringNetwork::toExplicit(const GridCoefficients& grid, int maxN)
+{
+    // The connections are solved for the linear explicit stencil
+    GridCoefficients explicitGrid = grid;
+    if (explicitGrid.isImplicit() || explicitGrid.isNonlinear())
+    {
+        explicitGrid.theta = 1.0;
+        explicitGrid.tension = 0.0;
+        explicitGrid.calculateGrid(maxN);
+    }
+    return explicitGrid;
+}
+
+int StringNetwork::addConnection(const Connection& connection)
+{
+    jassert(connection.stringA >= 0 && connection.stringA < numStrings && connection.stringB < numStrings);
+    if (numConnections == maxConnections) return -1;
+
+    connections[numConnections] = connection;
+    psi[numConnections] = 0.0;
+    if (connection.type == Connection::rattle || connection.K3 != 0.0) nonlinear = true;
+    return numConnections++;
+}
+
+void StringNetwork::setBridge(double mass, double f0, double sig0)
+{
+    bridgeMass = mass;
+    bridgeOmegaSq = 4.0 * double_Pi * double_Pi * f0 * f0;
+    bridgeSig0 = sig0;
+}
+
+void StringNetwork::setPickups(const Pickups& pickups)
+{
+    for (auto* string : strings)
+        string->setPickups(pickups);
+}
+
+void StringNetwork::calculateCoupling()
+{
+    // Read every block, so damping changes on a string reach its gain. A unit force spread with w
+    // moves the grid by gain * w in one sample, the bridge by bridgeGain
+    for (int s = 0; s < numStrings; ++s)
+    {
+        const GridCoefficients& grid = strings[s]->grid;
+        gains[s] = grid.k * grid.k / (grid.rho * grid.A * grid.h * (1.0 + grid.S0));
+    }
+    bridgeGain = bridgeMass > 0.0 ? k * k / (bridgeMass * (1.0 + bridgeSig0 * k)) : 0.0;
+
+    for (int c = 0; c < numConnections; ++c)
+    {
+        const Connection& connection = connections[c];
+        const int ends[2] = { connection.stringA, connection.stringB };
+        const float positions[2] = { connection.posA, connection.posB };
+
+        for (int e = 0; e < 2; ++e)
+        {
+            Terminal& terminal = terminals[c][e];
+            terminal.string = ends[e];
+            if (terminal.string < 0) continue;
+
+            // The weights stay inside the string, like the bow. A grid too short for them
+            // connects at the nearest point inside the string, a string without one is left out
+            const int N = strings[terminal.string]->N;
+            if (N < Bow::minGridSize)
+            {
+                terminal.l = jmax(0, jmin(N - 1, roundToInt(positions[e] * N)));
+                for (int j = 0; j < 4; ++j)
+                    terminal.w[j] = j == 1 && terminal.l > 0 ? 1.0 : 0.0;
+                continue;
+            }
+
+            double position = jlimit(2.0, N - 3.0, static_cast<double> (positions[e]) * N);
+            terminal.l = static_cast<int> (position);
+            Spreading::lagrangeWeights(position - terminal.l, terminal.w);
+        }
+    }
+
+    // Connections only see each other through a shared string or the bridge, everything else stays zero
+    for (int c = 0; c < numConnections; ++c)
+    {
+        for (int d = 0; d < numConnections; ++d)
+        {
+            double response = 0.0;
+            for (int e = 0; e < 2; ++e)
+            {
+                for (int g = 0; g < 2; ++g)
+                {
+                    const Terminal& tc = terminals[c][e];
+                    const Terminal& td = terminals[d][g];
+                    if (tc.string != td.string || tc.string == ground) continue;
+
+                    // The A end takes the force with a plus, the B end with a minus
+                    double sign = (e == g) ? 1.0 : -1.0;
+                    if (tc.string == bridge)
+                    {
+                        response += sign * bridgeGain;
+                        continue;
+                    }
+
+                    double overlap = 0.0;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        int j = tc.l + i - td.l;
+                        if (j >= 0 && j < 4) overlap += tc.w[i] * td.w[j];
+                    }
+                    response += sign * gains[tc.string] * overlap;
+                }
+            }
+            M[c][d] = response;
+        }
+    }
+
+    // Linear connections have the same system every sample
+    for (int c = 0; c < numConnections; ++c)
+        a[c] = 0.5 * connections[c].K1 + 0.5 * connections[c].R / k;
+    if (!nonlinear) factorize();
+}
+
+void StringNetwork::factorize()
+{
+    // LU of I + diag(a) M. M is positive semidefinite and a is not negative, so this is a scaled
+    // positive definite matrix and needs no pivoting. Zero entries are skipped, so connections
+    // that share nothing cost nothing in the elimination
+    const int C = numConnections;
+    for (int c = 0; c < C; ++c)
+        for (int d = 0; d < C; ++d)
+            LU[c][d] = (c == d ? 1.0 : 0.0) + a[c] * M[c][d];
+
+    for (int p = 0; p < C; ++p)
+    {
+        for (int c = p + 1; c < C; ++c)
+        {
+            if (LU[c][p] == 0.0) continue;
+            double factor = LU[c][p] / LU[p][p];
+            LU[c][p] = factor;
+            for (int d = p + 1; d < C; ++d)
+                LU[c][d] -= factor * LU[p][d];
+        }
+    }
+}
+
+double StringNetwork::read(const Terminal& terminal, int row)
+{
+    if (terminal.string == ground) return 0.0;
+    if (terminal.string == bridge) return x[row];
+
+    const double* u = strings[terminal.string]->u[row] + terminal.l - 1;
+    return terminal.w[0] * u[0] + terminal.w[1] * u[1] + terminal.w[2] * u[2] + terminal.w[3] * u[3];
+}
+
+void StringNetwork::renderBlock(float* outL, float* outR, int numSamples, const float* bridgeForce)
+{
+    // Without outR both channels are mixed into outL. bridgeForce drives the bridge from strings
+    // that are not part of the network, it doesn't feel the bridge in return
+    calculateCoupling();
+    outputs[0] = outL;
+    outputs[1] = outR;
+    drive = bridgeForce;
+
+    // Split the block at the first pending event of any string, like a StringBank
+    int n = 0;
+    while (n < numSamples)
+    {
+        int end = numSamples;
+        for (int s = 0; s < numStrings; ++s)
+            end = jmin(end, strings[s]->applyEvents(n, numSamples));
+
+        renderSamples(n, end - n);
+        n = end;
+    }
+
+    for (int s = 0; s < numStrings; ++s)
+        strings[s]->endBlock(numSamples);
+}
+
+void StringNetwork::renderSamples(int offset, int numSamples)
+{
+    for (int n = offset; n < offset + numSamples; ++n)
+    {
+        // Every string and the bridge on its own
+        for (int s = 0; s < numStrings; ++s)
+        {
+            StiffString& string = *strings[s];
+            string.calculateScheme(string.u[0], string.u[1], string.u[2]);
+            if (string.bowed)
+            {
+                string.advanceBow();
+                string.bow.setExcitation(string.u[0], string.u[1], string.u[2], 1, string.ePos, string.vb);
+            }
+        }
+
+        const double sk = bridgeSig0 * k;
+        x[0] = bridgeMass > 0.0 ? ((2.0 - bridgeOmegaSq * k * k) * x[1] - (1.0 - sk) * x[2]) / (1.0 + sk) : 0.0;
+        if (drive != nullptr) x[0] += bridgeGain * drive[n];
+
+        solveConnections();
+
+        // Output and pointer switch
+        float left = 0.0f, right = 0.0f;
+        for (int s = 0; s < numStrings; ++s)
+        {
+            StiffString& string = *strings[s];
+            float l, r;
+            string.pickups.gather(string.u[0], 1, l, r);
+            left += l;
+            right += r;
+
+            double* uTmp = string.u[2];
+            string.u[2] = string.u[1];
+            string.u[1] = string.u[0];
+            string.u[0] = uTmp;
+        }
+
+        if (outputs[1] != nullptr)
+        {
+            outputs[0][n] = left;
+            outputs[1][n] = right;
+        }
+        else outputs[0][n] = 0.5f * (left + right);
+
+        x[2] = x[1];
+        x[1] = x[0];
+    }
+}
+
+void StringNetwork::solveConnections()
+{
+    // Each connection pushes with f = -K mu(eta) - R delta(eta) on its relative displacement eta, where
+    // mu and delta are the centered average and difference of the next and previous eta. The next eta
+    // is the free update plus M f, which makes (I + diag(a) M) f = -a etaFree - b etaPrevious - c.
+    // A rattle pushes with -g mu(psi) instead, psi moves by g delta(eta) and its energy stays psi^2 / 2
+    const int C = numConnections;
+    if (C == 0) return;
+
+    double rhs[maxConnections];
+    for (int c = 0; c < C; ++c)
+    {
+        const Connection& connection = connections[c];
+        double etaFree = read(terminals[c][0], 0) - read(terminals[c][1], 0);
+        double eta = read(terminals[c][0], 1) - read(terminals[c][1], 1);
+        double etaPrevious = read(terminals[c][0], 2) - read(terminals[c][1], 2);
+
+        // Cubic springs stiffen with the current stretch, rattles only push beyond the gap
+        double damping = 0.5 * connection.R / k;
+        if (connection.type == Connection::rattle)
+        {
+            g[c] = std::abs(eta) > connection.gap ? std::sqrt(connection.K1) * (eta > 0.0 ? 1.0 : -1.0) : 0.0;
+            a[c] = 0.25 * g[c] * g[c] + damping;
+            rhs[c] = -a[c] * (etaFree - etaPrevious) - g[c] * psi[c];
+            continue;
+        }
+
+        double K = connection.K1 + connection.K3 * eta * eta;
+        a[c] = 0.5 * K + damping;
+        rhs[c] = -a[c] * etaFree - (0.5 * K - damping) * etaPrevious;
+    }
+
+    if (nonlinear) factorize();
+
+    // Forward and back substitution
+    for (int c = 0; c < C; ++c)
+    {
+        double sum = rhs[c];
+        for (int d = 0; d < c; ++d)
+            sum -= LU[c][d] * f[d];
+        f[c] = sum;
+    }
+    for (int c = C - 1; c >= 0; --c)
+    {
+        double sum = f[c];
+        for (int d = c + 1; d < C; ++d)
+            sum -= LU[c][d] * f[d];
+        f[c] = sum / LU[c][c];
+    }
+
+    // Spread the forces, plus on the A end and minus on the B end
+    for (int c = 0; c < C; ++c)
+    {
+        for (int e = 0; e < 2; ++e)
+        {
+            const Terminal& terminal = terminals[c][e];
+            double force = e == 0 ? f[c] : -f[c];
+            if (terminal.string == ground) continue;
+            if (terminal.string == bridge)
+            {
+                x[0] += bridgeGain * force;
+                continue;
+            }
+
+            double* u = strings[terminal.string]->u[0] + terminal.l - 1;
+            double scaled = gains[terminal.string] * force;
+            for (int i = 0; i < 4; ++i)
+                u[i] += scaled * terminal.w[i];
+        }
+    }
+
+    // Out of contact the leftover psi is dropped, which can only take energy out
+    for (int c = 0; c < C; ++c)
+    {
+        if (connections[c].type != Connection::rattle) continue;
+        if (g[c] == 0.0) psi[c] = 0.0;
+        else
+        {
+            double etaNext = read(terminals[c][0], 0) - read(terminals[c][1], 0);
+            double etaPrevious = read(terminals[c][0], 2) - read(terminals[c][1], 2);
+            psi[c] += 0.5 * g[c] * (etaNext - etaPrevious);
+        }
+    }
+}
+
+double StringNetwork::getEnergy()
+{
+    // Strings, the bridge and the potential of the springs between the last two states
+    double energy = 0.0;
+    for (int s = 0; s < numStrings; ++s)
+        energy += strings[s]->getEnergy();
+
+    if (bridgeMass > 0.0)
+    {
+        double v = (x[1] - x[2]) / k;
+        energy += 0.5 * bridgeMass * v * v + 0.5 * bridgeMass * bridgeOmegaSq * x[1] * x[2];
+    }
+
+    for (int c = 0; c < numConnections; ++c)
+    {
+        const Connection& connection = connections[c];
+        double eta = read(terminals[c][0], 1) - read(terminals[c][1], 1);
+        double etaPrevious = read(terminals[c][0], 2) - read(terminals[c][1], 2);
+
+        if (connection.type == Connection::rattle) energy += 0.5 * psi[c] * psi[c];
+        else
+        {
+            energy += 0.25 * connection.K1 * (eta * eta + etaPrevious * etaPrevious)
+                + 0.25 * connection.K3 * eta * eta * etaPrevious * etaPrevious;
+        }
+    }
+
+    return energy;
+}
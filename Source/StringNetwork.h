@@ -0,0 +1,103 @@
+/*
+  ==============================================================================
+
+    StringNetwork.h
+    Created: 27 Jun 2022 2:18:44pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StiffString.h"
+
+// Strings coupled by springs and rattles, to each other, to the ground or to a bridge, which
+// is a damped mass on a spring. Every sample the strings run their own stencil and bow, then
+// the connection forces are solved from a small linear system and spread back onto the strings.
+// The springs act on the average of the next and previous displacement and rattles on an auxiliary
+// square root of their energy, which keeps the coupling stable for any stiffness. Strings always
+// use the explicit scheme
+class StringNetwork
+{
+
+public:
+    struct Connection
+    {
+        enum Type { spring, rattle };
+
+        Type type = spring;
+        int stringA = 0;  float posA = 0.5f;            // first end, on a string
+        int stringB = -1; float posB = 0.5f;            // second end, a string, ground or bridge
+        double K1 = 1e4;                                // linear stiffness in N/m
+        double K3 = 0.0;                                // cubic stiffness in N/m^3, springs only
+        double R = 0.0;                                 // damping in kg/s
+        double gap = 0.0;                               // rattles only touch beyond this distance in m
+    };
+
+    StringNetwork();      // Constructor
+    ~StringNetwork();     // Destructor
+
+    void prepare(double Fs, int maxN);
+    int addString(const GridCoefficients& grid);
+    void retuneString(int s, const GridCoefficients& grid);
+    int addConnection(const Connection& connection);
+    void setBridge(double mass, double f0, double sig0);
+    void clear();
+    void setPickups(const Pickups& pickups);
+    void renderBlock(float* outL, float* outR, int numSamples, const float* bridgeForce = nullptr);
+    double getEnergy();
+
+    StiffString& getString(int i) { return *strings[i]; };
+    int getNumStrings() { return numStrings; };
+    int getNumConnections() { return numConnections; };
+
+    static const int ground = -1;                       // stringB of a connection to a fixed point
+    static const int bridge = -2;                       // stringB of a connection to the bridge
+    static const int maxStrings = 12;
+    static const int maxConnections = 24;
+
+private:
+    static GridCoefficients toExplicit(const GridCoefficients& grid, int maxN);
+
+    struct Terminal
+    {
+        int string;                                     // string index, ground or bridge
+        int l;                                          // weights start at grid point l - 1
+        double w[4];                                    // cubic Lagrange weights
+    };
+
+    void calculateCoupling();
+    void renderSamples(int offset, int numSamples);
+    void solveConnections();
+    double read(const Terminal& terminal, int row);
+    void factorize();
+
+    double Fs = 48000.0;
+    double k = 1.0 / 48000.0;
+    int maxN = 0;
+
+    OwnedArray<StiffString> strings;
+    int numStrings = 0;
+    double gains[maxStrings];                           // displacement of a grid point per unit force
+
+    Connection connections[maxConnections];
+    Terminal terminals[maxConnections][2];              // both ends of every connection
+    int numConnections = 0;
+    bool nonlinear = false;                             // a cubic spring or rattle needs a new factorization every sample
+
+    double M[maxConnections][maxConnections];           // response of each connection to a unit force in another
+    double LU[maxConnections][maxConnections];          // factorized system, kept while it is linear
+    double a[maxConnections], f[maxConnections];
+    double psi[maxConnections];                         // rattle energy as sqrt(2 V) at n + 1/2
+    double g[maxConnections];                           // gradient of psi over the relative displacement
+
+    double bridgeMass = 0.0;                            // no bridge, connections to it act like ground
+    double bridgeOmegaSq = 0.0, bridgeSig0 = 0.0;
+    double bridgeGain = 0.0;
+    double x[3] = { 0.0, 0.0, 0.0 };                    // bridge displacement at n + 1, n and n - 1
+
+    float* outputs[2] = { nullptr, nullptr };
+    const float* drive = nullptr;                       // force on the bridge in N from outside the network
+};
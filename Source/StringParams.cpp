@@ -0,0 +1,70 @@
+/*
+  ==============================================================================
+
+    StringParams.cpp
+    Created: 19 Apr 2022 11:40:18am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "StringParams.h"
+
+StringParamsBuffer::StringParamsBuffer()
+{
+    publish(StringParams());
+}
+
+StringParamsBuffer::~StringParamsBuffer()
+{
+
+}
+
+void StringParamsBuffer::publish(const StringParams& params)
+{
+    // Claim the write by making the sequence odd, so concurrent writers take turns
+    uint32 s = sequence.load(std::memory_order_relaxed);
+    while ((s & 1) != 0 || !sequence.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+        s = sequence.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    f0.store(params.f0, std::memory_order_relaxed);
+    L.store(params.L, std::memory_order_relaxed);
+    E.store(params.E, std::memory_order_relaxed);
+    rho.store(params.rho, std::memory_order_relaxed);
+    r.store(params.r, std::memory_order_relaxed);
+    sig0.store(params.sig0, std::memory_order_relaxed);
+    sig1.store(params.sig1, std::memory_order_relaxed);
+    theta.store(params.theta, std::memory_order_relaxed);
+    gridScale.store(params.gridScale, std::memory_order_relaxed);
+    tension.store(params.tension, std::memory_order_relaxed);
+
+    sequence.store(s + 2, std::memory_order_release);
+}
+
+StringParams StringParamsBuffer::read() const
+{
+    StringParams params;
+    uint32 before, after;
+
+    do
+    {
+        before = sequence.load(std::memory_order_acquire);
+
+        params.f0 = f0.load(std::memory_order_relaxed);
+        params.L = L.load(std::memory_order_relaxed);
+        params.E = E.load(std::memory_order_relaxed);
+        params.rho = rho.load(std::memory_order_relaxed);
+        params.r = r.load(std::memory_order_relaxed);
+        params.sig0 = sig0.load(std::memory_order_relaxed);
+        params.sig1 = sig1.load(std::memory_order_relaxed);
+        params.theta = theta.load(std::memory_order_relaxed);
+        params.gridScale = gridScale.load(std::memory_order_relaxed);
+        params.tension = tension.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    return params;
+}
@@ -0,0 +1,47 @@
+/*
+  ==============================================================================
+
+    StringParams.h
+    Created: 19 Apr 2022 11:40:18am
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Physical parameters of a string
+struct StringParams
+{
+    double f0 = 220.0;      // fundamental frequency in Hz
+    double L = 1.0;         // length in m
+    double E = 2e11;        // Young's modulus in Pa
+    double rho = 7850.0;    // density in kg/m^3
+    double r = 0.0005;      // radius in m
+    double sig0 = 1.0;      // frequency independent damping
+    double sig1 = 0.005;    // frequency dependent damping
+    double theta = 1.0;     // explicit part of the theta scheme, 1 is explicit and 0.5 or less is unconditionally stable
+    double gridScale = 1.0; // grid size of an implicit scheme relative to the explicit stability limit
+    double tension = 0.0;   // tension modulation, 0 is linear and 1 the full Kirchhoff-Carrier term
+};
+
+// Seqlock around a StringParams: any thread publishes, the audio thread reads a consistent
+// snapshot without locks or allocation. Readers retry while a write is in progress
+class StringParamsBuffer
+{
+
+public:
+    StringParamsBuffer();      // Constructor
+    ~StringParamsBuffer();     // Destructor
+
+    void publish(const StringParams& params);
+    StringParams read() const;
+    uint32 getVersion() const { return sequence.load(std::memory_order_acquire) >> 1; };
+
+private:
+    std::atomic<uint32> sequence { 0 };                 // odd while a write is in progress
+    std::atomic<double> f0, L, E, rho, r, sig0, sig1, theta, gridScale, tension;
+};
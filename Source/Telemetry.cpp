@@ -0,0 +1,144 @@
+/*
+  ==============================================================================
+
+    Telemetry.cpp
+    Created: 10 May 2022 2:31:06pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "Telemetry.h"
+
+Telemetry::Telemetry()
+    : Thread("StiffString telemetry")
+{
+
+}
+
+Telemetry::~Telemetry()
+{
+    enabled.store(false);
+    stopThread(1000);
+}
+
+void Telemetry::setEnabled(bool enabled, double Fs)
+{
+    this->Fs = Fs;
+    this->enabled.store(enabled);
+
+    if (enabled) startThread(1);
+    else stopThread(1000);
+}
+
+void Telemetry::setCsvFile(const File& file)
+{
+    const ScopedLock sl(historyLock);
+
+    file.deleteFile();
+    csv.reset(new FileOutputStream(file));
+    if (!csv->openedOk())
+    {
+        csv.reset();
+        return;
+    }
+
+    *csv << "block,microseconds,samples,voices,lateJobs,bowIterations,maxBowIterations,rebuilds";
+    for (int v = 0; v < maxVoices; ++v)
+        *csv << ",N" << String(v);
+    *csv << "\n";
+}
+
+void Telemetry::push(const BlockRecord& record)
+{
+    // Single producer: the audio thread. A full buffer drops the record instead of waiting
+    uint32 write = writeIndex.load(std::memory_order_relaxed);
+    if (write - readIndex.load(std::memory_order_acquire) >= static_cast<uint32> (capacity))
+    {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    records[write & (capacity - 1)] = record;
+    writeIndex.store(write + 1, std::memory_order_release);
+}
+
+void Telemetry::run()
+{
+    while (!threadShouldExit())
+    {
+        drain();
+        wait(20);
+    }
+    drain();
+}
+
+void Telemetry::drain()
+{
+    // The lock makes the drain thread and the query calls take turns as the single consumer
+    const ScopedLock sl(historyLock);
+
+    uint32 read = readIndex.load(std::memory_order_relaxed);
+    uint32 write = writeIndex.load(std::memory_order_acquire);
+    if (read == write) return;
+
+    const double ticksPerSecond = static_cast<double> (Time::getHighResolutionTicksPerSecond());
+
+    for (; read != write; ++read)
+    {
+        const BlockRecord& record = records[read & (capacity - 1)];
+        double microseconds = record.ticks / ticksPerSecond * 1e6;
+
+        totals.numBlocks++;
+        totals.meanMicroseconds += (microseconds - totals.meanMicroseconds) / totals.numBlocks;
+        totals.maxMicroseconds = jmax(totals.maxMicroseconds, microseconds);
+        if (record.numSamples > 0)
+            totals.maxLoad = jmax(totals.maxLoad, microseconds * 1e-6 * Fs / record.numSamples);
+        totals.maxBowIterations = jmax(totals.maxBowIterations, record.maxBowIterations);
+        totals.numRebuilds += record.numRebuilds;
+        for (int v = 0; v < maxVoices; ++v)
+            totals.maxGridSize = jmax(totals.maxGridSize, record.gridSize[v]);
+
+        history.push_back(record);
+        if (history.size() > historySize) history.pop_front();
+
+        if (csv != nullptr)
+        {
+            *csv << String(record.block) << "," << String(microseconds, 2) << "," << String(record.numSamples) << ","
+                 << String(record.numVoices) << "," << String(record.lateJobs) << "," << String(record.bowIterations) << ","
+                 << String(record.maxBowIterations) << "," << String(record.numRebuilds);
+            for (int v = 0; v < maxVoices; ++v)
+                *csv << "," << String(record.gridSize[v]);
+            *csv << "\n";
+        }
+    }
+
+    readIndex.store(read, std::memory_order_release);
+    if (csv != nullptr) csv->flush();
+}
+
+Telemetry::Summary Telemetry::getSummary()
+{
+    drain();
+
+    const ScopedLock sl(historyLock);
+    Summary summary = totals;
+    summary.numDropped = numDropped.load(std::memory_order_relaxed);
+    return summary;
+}
+
+std::vector<Telemetry::BlockRecord> Telemetry::getHistory()
+{
+    drain();
+
+    const ScopedLock sl(historyLock);
+    return std::vector<BlockRecord>(history.begin(), history.end());
+}
+
+void Telemetry::clearHistory()
+{
+    const ScopedLock sl(historyLock);
+    history.clear();
+    totals = Summary();
+    numDropped.store(0);
+}
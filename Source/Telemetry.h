@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    Telemetry.h
+    Created: 10 May 2022 2:31:06pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+// Per-block measurements of the voice pool. The audio thread pushes records into a lock-free
+// ring buffer, a background thread drains it into a history and an optional CSV file
+class Telemetry : private Thread
+{
+
+public:
+    static const int maxVoices = 16;                    // voices with a recorded grid size
+
+    struct BlockRecord
+    {
+        int64 block = 0;                                // block counter
+        int64 ticks = 0;                                // render time in high resolution ticks
+        int numSamples = 0;
+        int numVoices = 0;                              // active voices
+        int lateJobs = 0;                               // jobs the host rendered because a worker was late
+        int bowIterations = 0;                          // Newton iterations of all bowed voices
+        int maxBowIterations = 0;                       // most iterations of a single solve
+        int numRebuilds = 0;                            // grid rebuilds and retunes since the previous block
+        int gridSize[maxVoices] = {};                   // N of every voice, 0 when idle
+    };
+
+    struct Summary
+    {
+        int64 numBlocks = 0;
+        int64 numDropped = 0;                           // records lost because the ring buffer was full
+        double meanMicroseconds = 0.0;
+        double maxMicroseconds = 0.0;
+        double maxLoad = 0.0;                           // largest render time / block duration
+        int maxBowIterations = 0;
+        int64 numRebuilds = 0;
+        int maxGridSize = 0;
+    };
+
+    Telemetry();      // Constructor
+    ~Telemetry();     // Destructor
+
+    // Message thread
+    void setEnabled(bool enabled, double Fs);
+    void setCsvFile(const File& file);
+    Summary getSummary();
+    std::vector<BlockRecord> getHistory();
+    void clearHistory();
+
+    // Audio thread
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); };
+    void push(const BlockRecord& record);
+
+    static const int capacity = 1024;                   // ring buffer size, a power of two
+    static const int historySize = 8192;
+
+private:
+    void run() override;
+    void drain();
+
+    std::atomic<bool> enabled { false };
+    double Fs = 48000.0;
+
+    BlockRecord records[capacity];
+    std::atomic<uint32> writeIndex { 0 }, readIndex { 0 };
+    std::atomic<int64> numDropped { 0 };
+
+    CriticalSection historyLock;
+    std::deque<BlockRecord> history;
+    Summary totals;
+    std::unique_ptr<FileOutputStream> csv;
+};
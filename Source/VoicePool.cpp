@@ -0,0 +1,834 @@
+/*
+  ==============================================================================
+
+    VoicePool.cpp
+    Created: 14 Mar 2022 2:12:31pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#include "VoicePool.h"
+
+VoicePool::VoicePool()
+{
+
+}
+
+VoicePool::~VoicePool()
+{
+    workers.stop();
+}
+
+void VoicePool::prepare(double Fs, const StringParams& params, int maxGridSize, int numVoices, int maxBlockSize, int numWorkers)
+{
+    // All allocation happens here, the audio thread only reuses the voices
+    workers.stop();
+
+    // The strings run at the simulation rate, the resampler converts every block to the host rate
+    maxHostBlockSize = maxBlockSize;
+    if (resamplers[0].prepare(simulationFs, Fs, resamplerQuality, maxBlockSize))
+    {
+        resamplers[1].prepare(simulationFs, Fs, resamplerQuality, maxBlockSize);
+        Fs = simulationFs;
+        maxBlockSize = resamplers[0].getMaxInput(maxBlockSize);
+    }
+    for (auto& simulationBuffer : simulationBuffers)
+        simulationBuffer = vector<float>(resamplers[0].isActive() ? maxBlockSize : 0, 0.0f);
+
+    this->Fs = Fs;
+    this->maxBlockSize = maxBlockSize;
+    this->maxGridSize = maxGridSize;
+    cache.build(Fs, params, maxGridSize);
+    fadeLength = static_cast<int> (0.005 * Fs);
+
+    sympathetic.prepare(Fs, maxGridSize);
+    tuneSympathetic(false);
+    for (auto& sympatheticBuffer : sympatheticBuffers)
+        sympatheticBuffer = vector<float>(maxBlockSize, 0.0f);
+    bridgeForce = vector<float>(maxBlockSize, 0.0f);
+
+    voices.clear();
+    for (int i = 0; i < numVoices; ++i)
+    {
+        // Both precisions are allocated, so every voice can switch at note-on
+        StringVoice* voice = voices.add(new StringVoice());
+        voice->string.setFs(Fs);
+        voice->string.allocateGrid(maxGridSize);
+        voice->string.setGrid(cache.getMaterial());
+        voice->stringFloat.setFs(Fs);
+        voice->stringFloat.allocateGrid(maxGridSize);
+        voice->stringFloat.setGrid(cache.getMaterial());
+        voice->fade.setFs(Fs);
+        voice->fade.allocateGrid(maxGridSize);
+        voice->fadeFloat.setFs(Fs);
+        voice->fadeFloat.allocateGrid(maxGridSize);
+        voice->modal.allocate(maxGridSize);
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            voice->buffer[channel] = vector<float>(maxBlockSize, 0.0f);
+            voice->fadeBuffer[channel] = vector<float>(maxBlockSize, 0.0f);
+        }
+    }
+    activeVoices = vector<StringVoice*>(numVoices, nullptr);
+    setPickups(nullptr, -1);
+
+    banks.clear();
+    for (int i = 0; i < numVoices / StringBank::minStrings; ++i)
+        banks.add(new StringBank())->allocate(maxGridSize);
+    activeBanks = vector<StringBank*>(banks.size(), nullptr);
+    noteCounter = 0;
+
+    workers.start(jmin(numWorkers, numVoices - 1));
+}
+
+void VoicePool::setSimulationRate(double simulationFs, Resampler::Quality quality)
+{
+    // Takes effect at the next prepare, maxGridSize passed there should be sized for this rate
+    this->simulationFs = simulationFs;
+    resamplerQuality = quality;
+}
+
+void VoicePool::setPickups(const Pickups::Pickup* pickups, int numPickups)
+{
+    // Copies the pickups into every voice, allocation free. A negative count reapplies the current ones
+    if (numPickups >= 0) this->pickups.setPickups(pickups, numPickups);
+
+    sympathetic.setPickups(this->pickups);
+    for (auto* voice : voices)
+    {
+        voice->string.setPickups(this->pickups);
+        voice->stringFloat.setPickups(this->pickups);
+        voice->fade.setPickups(this->pickups);
+        voice->fadeFloat.setPickups(this->pickups);
+        voice->modal.setPickups(this->pickups);
+    }
+}
+
+void VoicePool::releaseResources()
+{
+    workers.stop();
+}
+
+void VoicePool::noteOn(int noteNumber, double f0)
+{
+    StringVoice* voice = findVoice(noteNumber);
+
+    // Retrigger a ringing string if it is still tuned to the same pitch, and glide a held string to a new pitch
+    if (voice != nullptr && voice->f0 != f0 && !voice->isReleased && voice->singlePrecision == singlePrecision)
+    {
+        retune(voice, noteNumber, f0);
+    }
+    else if (voice == nullptr || voice->f0 != f0 || voice->singlePrecision != singlePrecision)
+    {
+        if (voice == nullptr) voice = findFreeVoice();
+        leaveBank(voice);
+        voice->fadeSamples = 0;
+
+        const GridCoefficients grid = getGrid(noteNumber, f0);
+        ++numRebuilds;
+        voice->singlePrecision = singlePrecision;
+        voice->withString([&](auto& string)
+        {
+            string.setGrid(grid);
+            string.bowed = false;
+            string.vb = 0.0;
+        });
+        voice->modal.setGrid(grid);
+        voice->useModal = modalPlucks && !grid.isNonlinear();      // modes can't follow the tension
+        voice->f0 = f0;
+        voice->isSleeping = true;   // silent until the first excitation
+
+    }
+    else if (voice->isReleased)
+    {
+        double sig0 = cache.getMaterial().sig0;
+        if (voice->useModal) voice->modal.setDamping(sig0);
+        else voice->withString([&](auto& string) { string.setDamping(sig0); });
+    }
+
+    voice->noteNumber = noteNumber;
+    voice->isActive = true;
+    voice->isReleased = false;
+    voice->startTime = noteCounter++;
+
+    if (voice->bank == nullptr) joinBank(voice);
+}
+
+void VoicePool::noteOff(int noteNumber)
+{
+    StringVoice* voice = findVoice(noteNumber);
+    if (voice == nullptr || voice->isReleased) return;
+
+    // A silent voice is free straight away
+    if (voice->isSleeping)
+    {
+        voice->isActive = false;
+        voice->isSleeping = false;
+        return;
+    }
+
+    // Damp the string and free the voice after its 60 dB decay time
+    double sig0 = jmax(releaseSig0, cache.getMaterial().sig0);
+    if (voice->useModal) voice->modal.setDamping(sig0);
+    voice->withString([&](auto& string)
+    {
+        string.setDamping(sig0);
+        string.bowed = false;
+        string.vb = 0.0;
+    });
+    voice->isReleased = true;
+    voice->releaseSamples = static_cast<int> (3.0 * log(10.0) / sig0 * Fs);
+}
+
+void VoicePool::exciteNote(int noteNumber, int offset, double amp, float pos, int width, bool strike)
+{
+    StringVoice* voice = findVoice(noteNumber);
+    if (voice == nullptr) return;
+
+    offset = toSimulation(offset);
+    wake(voice);
+    if (voice->useModal) voice->modal.queueExcitation(offset, amp, pos, width, strike);
+    else voice->withString([&](auto& string) { string.queueExcitation(offset, amp, pos, width, strike); });
+}
+
+void VoicePool::setBow(int noteNumber, int offset, bool bowed, double vb, float pos)
+{
+    StringVoice* voice = findVoice(noteNumber);
+    if (voice == nullptr || voice->isReleased) return;
+
+    offset = toSimulation(offset);
+
+    // A bow resting on a silent string changes nothing, and the stroke already playing is sent
+    // again every block. Neither may wake the voice or reset its sleep level
+    if (bowed && vb == 0.0 && voice->isSleeping) return;
+    if (!voice->isSleeping && !voice->useModal)
+    {
+        bool unchanged = false;
+        voice->withString([&](auto& string) { unchanged = string.matchesBow(bowed, vb, pos); });
+        if (unchanged) return;
+    }
+    if (bowed) wake(voice);
+
+    // The modes cannot be bowed, so the string takes over their state and the bow from here on
+    if (voice->useModal && bowed)
+    {
+        voice->withString([&](auto& string) { voice->modal.copyStateTo(string); });
+        voice->useModal = false;
+        joinBank(voice);
+    }
+
+    if (voice->useModal) return;
+    voice->withString([&](auto& string) { string.queueBow(offset, bowed, vb, pos); });
+}
+
+void VoicePool::updateGrids(const StringParams& params)
+{
+    // Material parameters changed, rebuild the cache and move every sounding voice to its new grid.
+    // Voices that keep their grid size only glide to the new coefficients
+    cache.build(Fs, params, maxGridSize);
+    tuneSympathetic(true);
+
+    for (auto* voice : voices)
+    {
+        if (!voice->isActive) continue;
+
+        // A sleeping voice is silent, it takes the new grid without a crossfade or a rebuild
+        if (voice->isSleeping)
+        {
+            const GridCoefficients grid = getGrid(voice->noteNumber, voice->f0);
+            voice->withString([&](auto& string) { string.setGrid(grid); });
+            voice->modal.setGrid(grid);
+            voice->useModal = modalPlucks && !grid.isNonlinear();
+            continue;
+        }
+
+        retune(voice, voice->noteNumber, voice->f0);
+        if (voice->isReleased)
+        {
+            double sig0 = jmax(releaseSig0, cache.getMaterial().sig0);
+            if (voice->useModal) voice->modal.setDamping(sig0);
+            else voice->withString([&](auto& string) { string.setDamping(sig0); });
+        }
+    }
+}
+
+void VoicePool::writeState(MemoryOutputStream& stream)
+{
+    // Every sounding voice with its note, release and string state. Retune crossfades and
+    // pending events are left out
+    int count = 0;
+    for (auto* voice : voices)
+        if (voice->isActive) ++count;
+
+    stream.writeDouble(Fs);
+    stream.writeInt(count);
+    for (auto* voice : voices)
+    {
+        if (!voice->isActive) continue;
+
+        stream.writeInt(voice->noteNumber);
+        stream.writeDouble(voice->f0);
+        stream.writeBool(voice->isReleased);
+        stream.writeDouble(voice->releaseSamples / Fs);
+        stream.writeBool(voice->singlePrecision);
+        stream.writeBool(voice->useModal);
+        stream.writeBool(voice->isSleeping);
+        stream.writeDouble(voice->peakEnergy);
+        if (voice->isSleeping) continue;
+
+        if (voice->useModal) voice->modal.writeState(stream);
+        else voice->withString([&](auto& string) { string.writeState(stream); });
+    }
+}
+
+bool VoicePool::readState(MemoryInputStream& stream)
+{
+    // Replaces all voices with the ones written by writeState. The grids come from the cache,
+    // so updateGrids has to run with the restored parameters first. A state of the same grid
+    // size and rate is copied as it is, anything else is resampled. The state comes from the
+    // host, so anything out of range rejects all of it and leaves every voice off
+    for (auto* voice : voices)
+    {
+        leaveBank(voice);
+        voice->isActive = false;
+        voice->fadeSamples = 0;
+    }
+
+    auto reject = [this]
+    {
+        for (auto* voice : voices)
+        {
+            leaveBank(voice);
+            voice->isActive = false;
+        }
+        return false;
+    };
+
+    const double storedFs = stream.readDouble();
+    const int count = stream.readInt();
+    if (!std::isfinite(storedFs) || storedFs <= 0.0 || count < 0 || count > voices.size()) return reject();
+    const double timeScale = storedFs / Fs;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int64 voiceBytes = sizeof(int) + 3 * sizeof(double) + 4;     // note, f0, release, energy and four flags
+        if (stream.getNumBytesRemaining() < voiceBytes) return reject();
+
+        const int noteNumber = stream.readInt();
+        const double f0 = stream.readDouble();
+        const bool isReleased = stream.readBool();
+        const double releaseSeconds = stream.readDouble();
+        const bool voiceSinglePrecision = stream.readBool();
+        const bool useModal = stream.readBool();
+        const bool isSleeping = stream.readBool();
+        const double peakEnergy = stream.readDouble();
+
+        // Notes outside the MIDI range, like the voice played through the parameters, are only
+        // looked up by their f0
+        if (noteNumber < 0 || !std::isfinite(f0) || f0 <= 0.0 || f0 >= 0.5 * Fs
+            || !std::isfinite(releaseSeconds) || releaseSeconds < 0.0 || !std::isfinite(peakEnergy))
+            return reject();
+
+        StringVoice* voice = findFreeVoice();
+        const GridCoefficients grid = getGrid(noteNumber, f0);
+        voice->singlePrecision = voiceSinglePrecision;
+        voice->withString([&](auto& string) { string.setGrid(grid); });
+        voice->modal.setGrid(grid);
+        voice->useModal = useModal;
+
+        if (!isSleeping)
+        {
+            bool valid = false;
+            if (useModal) valid = voice->modal.readState(stream, timeScale);
+            else voice->withString([&](auto& string) { valid = string.readState(stream, timeScale); });
+            if (!valid) return reject();
+        }
+
+        voice->noteNumber = noteNumber;
+        voice->f0 = f0;
+        voice->isActive = true;
+        voice->isSleeping = isSleeping;
+        voice->isReleased = false;
+        voice->peakEnergy = peakEnergy;
+        voice->startTime = noteCounter++;
+
+        if (isReleased)
+        {
+            double sig0 = jmax(releaseSig0, cache.getMaterial().sig0);
+            if (voice->useModal) voice->modal.setDamping(sig0);
+            else voice->withString([&](auto& string) { string.setDamping(sig0); });
+            voice->isReleased = true;
+            voice->releaseSamples = static_cast<int> (jmin(releaseSeconds * Fs, 1e9));
+        }
+
+        if (!isSleeping) joinBank(voice);
+    }
+    return true;
+}
+
+bool VoicePool::isNoteActive(int noteNumber)
+{
+    return findVoice(noteNumber) != nullptr;
+}
+
+void VoicePool::process(float* outL, float* outR, int numSamples)
+{
+    // Adds to outL and outR, without outR both channels are mixed into outL
+    if (!resamplers[0].isActive())
+    {
+        processSimulation(outL, outR, numSamples);
+        return;
+    }
+
+    // Render the simulation samples each host chunk needs and add them resampled to out
+    for (int offset = 0; offset < numSamples; offset += maxHostBlockSize)
+    {
+        int numOutput = jmin(maxHostBlockSize, numSamples - offset);
+        int numInput = resamplers[0].getNumInput(numOutput);
+        float* simulationL = simulationBuffers[0].data();
+        float* simulationR = outR != nullptr ? simulationBuffers[1].data() : nullptr;
+
+        fill(simulationL, simulationL + numInput, 0.0f);
+        if (simulationR != nullptr) fill(simulationR, simulationR + numInput, 0.0f);
+        processSimulation(simulationL, simulationR, numInput);
+
+        resamplers[0].process(simulationL, numInput, outL + offset, numOutput);
+        if (outR != nullptr) resamplers[1].process(simulationR, numInput, outR + offset, numOutput);
+    }
+}
+
+void VoicePool::processSimulation(float* outL, float* outR, int numSamples)
+{
+    // Hosts may send larger blocks than announced, so render in chunks of the prepared size
+    for (int offset = 0; offset < numSamples; offset += maxBlockSize)
+    {
+        blockSize = jmin(maxBlockSize, numSamples - offset);
+
+        // Jobs are the voices that play on their own, followed by the banks
+        numVoiceJobs = 0;
+        for (auto* voice : voices)
+            if (voice->isActive && !voice->isSleeping && voice->bank == nullptr)
+                activeVoices[numVoiceJobs++] = voice;
+
+        int numBankJobs = 0;
+        for (auto* bank : banks)
+            if (bank->getNumStrings() > 0)
+                activeBanks[numBankJobs++] = bank;
+
+        // Workers that have not started before half the block is over leave their voices to this thread
+        const bool recording = telemetry.isEnabled();
+        int64 start = recording ? Time::getHighResolutionTicks() : 0;
+        workers.run(*this, numVoiceJobs + numBankJobs, 0.5 * blockSize / Fs);
+        if (recording) record(Time::getHighResolutionTicks() - start);
+        if (sympatheticLevel > 0.0) fill(bridgeForce.begin(), bridgeForce.begin() + blockSize, 0.0f);
+
+        for (auto* voice : voices)
+        {
+            if (!voice->isActive || voice->isSleeping) continue;
+
+            const float* left = voice->buffer[0].data();
+            const float* right = voice->buffer[1].data();
+            if (sympatheticLevel > 0.0)
+            {
+                for (int n = 0; n < blockSize; ++n)
+                    bridgeForce[n] += left[n] + right[n];
+            }
+            if (outR != nullptr)
+            {
+                for (int n = 0; n < blockSize; ++n)
+                {
+                    outL[offset + n] += left[n];
+                    outR[offset + n] += right[n];
+                }
+            }
+            else
+            {
+                for (int n = 0; n < blockSize; ++n)
+                    outL[offset + n] += 0.5f * (left[n] + right[n]);
+            }
+
+            // A decayed voice sleeps, a released one is freed
+            voice->peakEnergy = jmax(voice->peakEnergy, voice->energy);
+            if (voice->energy <= sleepLevel * voice->peakEnergy)
+            {
+                bool busy = false;
+                if (voice->useModal) busy = voice->modal.hasPendingEvents();
+                else voice->withString([&](auto& string) { busy = string.isBowMoving() || string.hasPendingEvents(); });
+
+                if (!busy)
+                {
+                    sleep(voice);
+                    continue;
+                }
+            }
+
+            if (voice->fadeSamples > 0)
+            {
+                voice->fadeSamples -= blockSize;
+                if (voice->fadeSamples <= 0) joinBank(voice);
+            }
+
+            if (voice->isReleased)
+            {
+                voice->releaseSamples -= blockSize;
+                if (voice->releaseSamples <= 0)
+                {
+                    voice->isActive = false;
+                    leaveBank(voice);
+                }
+            }
+        }
+
+        if (sympatheticLevel > 0.0) renderSympathetic(outL + offset, outR != nullptr ? outR + offset : nullptr);
+    }
+}
+
+void VoicePool::renderJob(int job)
+{
+    if (job >= numVoiceJobs)
+    {
+        StringBank* bank = activeBanks[job - numVoiceJobs];
+        bank->renderBlock(blockSize);
+
+        for (auto* voice : voices)
+            if (voice->bank == bank) updateEnergy(voice);
+        return;
+    }
+
+    StringVoice* voice = activeVoices[job];
+    if (voice->useModal)
+    {
+        voice->modal.renderBlock(voice->buffer[0].data(), voice->buffer[1].data(), blockSize);
+        updateEnergy(voice);
+        return;
+    }
+
+    voice->withStrings([&](auto& string, auto& fade)
+    {
+        string.renderBlock(voice->buffer[0].data(), voice->buffer[1].data(), blockSize);
+        if (voice->fadeSamples <= 0) return;
+
+        // Crossfade from the string before the retune to the retuned string
+        fade.renderBlock(voice->fadeBuffer[0].data(), voice->fadeBuffer[1].data(), blockSize);
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            float* out = voice->buffer[channel].data();
+            const float* faded = voice->fadeBuffer[channel].data();
+            for (int n = 0; n < blockSize; ++n)
+            {
+                float gain = jmin(1.0f, static_cast<float> (fadeLength - voice->fadeSamples + n) / fadeLength);
+                out[n] = gain * out[n] + (1.0f - gain) * faded[n];
+            }
+        }
+    });
+    updateEnergy(voice);
+}
+
+StringVoice* VoicePool::findVoice(int noteNumber)
+{
+    for (auto* voice : voices)
+        if (voice->isActive && voice->noteNumber == noteNumber)
+            return voice;
+
+    return nullptr;
+}
+
+StringVoice* VoicePool::findFreeVoice()
+{
+    // Prefer an idle voice, then steal a silent voice, the oldest released voice and the oldest held voice
+    StringVoice* sleeping = nullptr;
+    StringVoice* oldestReleased = nullptr;
+    StringVoice* oldest = nullptr;
+
+    for (auto* voice : voices)
+    {
+        if (!voice->isActive) return voice;
+
+        if (voice->isSleeping && sleeping == nullptr)
+            sleeping = voice;
+        if (voice->isReleased && (oldestReleased == nullptr || voice->startTime < oldestReleased->startTime))
+            oldestReleased = voice;
+        if (oldest == nullptr || voice->startTime < oldest->startTime)
+            oldest = voice;
+    }
+
+    if (sleeping != nullptr) return sleeping;
+    return oldestReleased != nullptr ? oldestReleased : oldest;
+}
+
+void VoicePool::retune(StringVoice* voice, int noteNumber, double f0)
+{
+    const GridCoefficients grid = getGrid(noteNumber, f0);
+    voice->f0 = f0;
+
+    // The same grid takes new coefficients without touching the state, and stays in its bank
+    bool glides = false;
+    if (!voice->useModal)
+    {
+        voice->withString([&](auto& string)
+        {
+            glides = string.canGlideTo(grid);
+            if (glides) string.glideTo(grid);
+        });
+    }
+    if (glides) return;
+
+    // Keep the old string ringing on the fade copy while the retuned string fades in
+    leaveBank(voice);
+    ++numRebuilds;
+
+    // Modes keep their amplitudes at the new frequencies, which needs no crossfade
+    if (voice->useModal)
+    {
+        voice->modal.retune(grid);
+        voice->withString([&](auto& string) { string.setGrid(grid); });
+        return;
+    }
+
+    voice->withStrings([&](auto& string, auto& fade)
+    {
+        fade.copyStateFrom(string);
+        string.retune(grid);
+    });
+    voice->fadeSamples = fadeLength;
+}
+
+void VoicePool::sleep(StringVoice* voice)
+{
+    // Zero the decayed state so it costs nothing, a released voice is done
+    leaveBank(voice);
+    voice->fadeSamples = 0;
+
+    if (voice->isReleased)
+    {
+        voice->isActive = false;
+        return;
+    }
+
+    voice->isSleeping = true;
+    voice->modal.clearState();
+    voice->withString([&](auto& string) { string.clearState(); });
+}
+
+void VoicePool::wake(StringVoice* voice)
+{
+    // The energy of the new excitation sets the next sleep level
+    voice->peakEnergy = 0.0;
+    if (!voice->isSleeping) return;
+
+    voice->isSleeping = false;
+    joinBank(voice);
+}
+
+void VoicePool::updateEnergy(StringVoice* voice)
+{
+    // Once per block on the thread that rendered the voice, a single pass over the grid
+    if (voice->useModal) voice->energy = voice->modal.getEnergy();
+    else voice->withString([&](auto& string) { voice->energy = string.getEnergy(); });
+}
+
+void VoicePool::record(int64 ticks)
+{
+    Telemetry::BlockRecord record;
+    record.block = blockCounter++;
+    record.ticks = ticks;
+    record.numSamples = blockSize;
+    record.lateJobs = workers.getNumLateJobs();
+    record.numRebuilds = numRebuilds;
+    numRebuilds = 0;
+
+    for (int v = 0; v < voices.size(); ++v)
+    {
+        StringVoice* voice = voices[v];
+        if (!voice->isActive) continue;
+
+        ++record.numVoices;
+        voice->withString([&](auto& string)
+        {
+            if (v < Telemetry::maxVoices) record.gridSize[v] = string.getGridSize();
+
+            // The solver counts since the last record
+            const Bow::SolverStats& stats = string.getBowStats();
+            record.bowIterations += static_cast<int> (stats.totalIterations);
+            record.maxBowIterations = jmax(record.maxBowIterations, stats.maxIterations);
+            string.resetBowStats();
+        });
+    }
+
+    telemetry.push(record);
+}
+
+int VoicePool::toSimulation(int offset) const
+{
+    // Event offsets arrive in host samples, the strings count in simulation samples
+    return resamplers[0].isActive() ? resamplers[0].getNumInput(offset) : offset;
+}
+
+GridCoefficients VoicePool::getGrid(int noteNumber, double f0)
+{
+    // MIDI notes are a table lookup, other pitches are calculated from the cached material
+    if (noteNumber >= 0 && noteNumber < CoefficientCache::numNotes && cache.getNote(noteNumber).f0 == f0)
+        return cache.getNote(noteNumber);
+
+    return cache.getFrequency(f0);
+}
+
+void VoicePool::renderSympathetic(float* outL, float* outR)
+{
+    // The voices push on the bridge with their summed output and the open strings pick up what
+    // they share with it. The voices don't feel the bridge in return: they render a whole block
+    // in parallel before the bridge moves, so any feedback would arrive a block late and could
+    // add energy to the voices
+    const float gain = static_cast<float> (0.5 * sympatheticLevel * sympatheticTuning.drive);
+    for (int n = 0; n < blockSize; ++n)
+        bridgeForce[n] *= gain;
+
+    float* left = sympatheticBuffers[0].data();
+    float* right = sympatheticBuffers[1].data();
+    sympathetic.renderBlock(left, right, blockSize, bridgeForce.data());
+
+    if (outR != nullptr)
+    {
+        for (int n = 0; n < blockSize; ++n)
+        {
+            outL[n] += left[n];
+            outR[n] += right[n];
+        }
+    }
+    else
+    {
+        for (int n = 0; n < blockSize; ++n)
+            outL[n] += 0.5f * (left[n] + right[n]);
+    }
+}
+
+void VoicePool::setSympatheticTuning(const SympatheticTuning& tuning)
+{
+    // Called before prepare or from the audio thread, a new tuning silences the strings
+    sympatheticTuning = tuning;
+    sympatheticTuning.numNotes = jlimit(0, StringNetwork::maxStrings, tuning.numNotes);
+    for (int s = 0; s < sympatheticTuning.numNotes; ++s)
+        sympatheticTuning.notes[s] = jlimit(0, CoefficientCache::numNotes - 1, tuning.notes[s]);
+
+    if (maxGridSize > 0) tuneSympathetic(false);
+}
+
+void VoicePool::tuneSympathetic(bool retune)
+{
+    // The open strings rest close to the bridge end. A retune keeps them ringing
+    if (!retune)
+    {
+        sympathetic.clear();
+        sympathetic.setBridge(0.05, 150.0, 30.0);
+    }
+
+    for (int s = 0; s < sympatheticTuning.numNotes; ++s)
+    {
+        const GridCoefficients& grid = cache.getNote(sympatheticTuning.notes[s]);
+        if (retune)
+        {
+            sympathetic.retuneString(s, grid);
+            continue;
+        }
+
+        StringNetwork::Connection connection;
+        connection.stringA = sympathetic.addString(grid);
+        connection.posA = 0.9f;
+        connection.stringB = StringNetwork::bridge;
+        connection.K1 = 5e4;
+        connection.R = 1.0;
+        sympathetic.addConnection(connection);
+    }
+}
+
+bool VoicePool::isBankable(StringVoice* voice)
+{
+    return voice->isActive && voice->bank == nullptr && !voice->singlePrecision && !voice->useModal && !voice->isSleeping
+        && voice->fadeSamples <= 0 && !voice->string.isImplicit() && !voice->string.isNonlinear();
+}
+
+void VoicePool::joinBank(StringVoice* voice)
+{
+    if (!interleaved || !isBankable(voice)) return;
+    int N = voice->string.getGridSize();
+
+    // Join a bank that already plays a grid close to this one
+    for (auto* bank : banks)
+    {
+        if (bank->getNumStrings() > 0 && bank->canHold(N)
+            && bank->addString(voice->string, voice->buffer[0].data(), voice->buffer[1].data()))
+        {
+            voice->bank = bank;
+            return;
+        }
+    }
+
+    StringBank* bank = nullptr;
+    for (auto* candidate : banks)
+    {
+        if (candidate->getNumStrings() == 0)
+        {
+            bank = candidate;
+            break;
+        }
+    }
+    if (bank == nullptr || !bank->canHold(N)) return;
+
+    // Otherwise open a new bank, but only with enough voices of a close grid size to beat
+    // rendering them on their own
+    StringVoice* members[StringBank::numLanes] = { voice };
+    int numMembers = 1, lo = N, hi = N;
+    for (auto* other : voices)
+    {
+        if (numMembers == StringBank::numLanes) break;
+        if (other == voice || !isBankable(other)) continue;
+
+        int otherN = other->string.getGridSize();
+        if (!StringBank::areClose(jmin(lo, otherN), jmax(hi, otherN))) continue;
+
+        lo = jmin(lo, otherN);
+        hi = jmax(hi, otherN);
+        members[numMembers++] = other;
+    }
+    if (numMembers < StringBank::minStrings) return;
+
+    for (int i = 0; i < numMembers; ++i)
+        if (bank->addString(members[i]->string, members[i]->buffer[0].data(), members[i]->buffer[1].data()))
+            members[i]->bank = bank;
+
+    // A string the bank turned down leaves it short, so the others play on their own again
+    if (bank->getNumStrings() < StringBank::minStrings)
+    {
+        for (int i = 0; i < numMembers; ++i)
+        {
+            if (members[i]->bank == bank)
+            {
+                bank->removeString(members[i]->string);
+                members[i]->bank = nullptr;
+            }
+        }
+    }
+}
+
+void VoicePool::leaveBank(StringVoice* voice)
+{
+    StringBank* bank = voice->bank;
+    if (bank == nullptr) return;
+
+    bank->removeString(voice->string);
+    voice->bank = nullptr;
+
+    // Too few strings play faster on their own
+    if (bank->getNumStrings() > 0 && bank->getNumStrings() < StringBank::minStrings)
+    {
+        for (auto* other : voices)
+        {
+            if (other->bank == bank)
+            {
+                bank->removeString(other->string);
+                other->bank = nullptr;
+            }
+        }
+    }
+}
@@ -0,0 +1,157 @@
+/*
+  ==============================================================================
+
+    VoicePool.h
+    Created: 14 Mar 2022 2:12:31pm
+    Author:  Helmer Nuijens
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StiffString.h"
+#include "ModalString.h"
+#include "Resampler.h"
+#include "RenderWorkers.h"
+#include "StringBank.h"
+#include "StringNetwork.h"
+#include "Telemetry.h"
+
+struct StringVoice
+{
+    StiffString string;
+    StiffStringFloat stringFloat;
+    bool singlePrecision = false;   // which of the two strings is playing
+    StringBank* bank = nullptr;     // shared interleaved state, if enough voices have a close N
+
+    StiffString fade;               // copy of the string before a retune, faded out
+    StiffStringFloat fadeFloat;
+
+    ModalString modal;              // plays plucks and strikes until the string is bowed
+    bool useModal = false;
+
+    template <typename Function>
+    void withString(Function function)
+    {
+        if (singlePrecision) function(stringFloat);
+        else function(string);
+    }
+
+    template <typename Function>
+    void withStrings(Function function)
+    {
+        if (singlePrecision) function(stringFloat, fadeFloat);
+        else function(string, fade);
+    }
+
+    int noteNumber = -1;
+    double f0 = 0.0;
+    bool isActive = false;
+    bool isReleased = false;
+    int64 startTime = 0;        // note-on counter, used to find the oldest voice
+    int releaseSamples = 0;     // samples left before a released voice is freed
+
+    int fadeSamples = 0;        // samples left in the retune crossfade
+
+    bool isSleeping = false;    // decayed to silence, not rendered until the next excitation
+    double energy = 0.0;        // energy at the end of the last rendered block
+    double peakEnergy = 0.0;    // largest energy since the last excitation
+
+    vector<float> buffer[2];    // rendered left and right block, summed by the pool
+    vector<float> fadeBuffer[2];
+};
+
+struct SympatheticTuning
+{
+    int notes[StringNetwork::maxStrings] = { 40, 45, 50, 55, 59, 64 };  // MIDI notes of the open strings, a guitar by default
+    int numNotes = 6;
+    double drive = 5.0;         // force on the bridge in N per unit of voice output at full sympathetic level
+};
+
+class VoicePool : public RenderJobs
+{
+
+public:
+    VoicePool();      // Constructor
+    ~VoicePool();     // Destructor
+
+    void prepare(double Fs, const StringParams& params, int maxGridSize, int numVoices, int maxBlockSize, int numWorkers);
+    void releaseResources();
+
+    void noteOn(int noteNumber, double f0);
+    void noteOff(int noteNumber);
+    void exciteNote(int noteNumber, int offset, double amp, float pos, int width, bool strike);
+    void setBow(int noteNumber, int offset, bool bowed, double vb, float pos);
+    void updateGrids(const StringParams& params);
+    void writeState(MemoryOutputStream& stream);
+    bool readState(MemoryInputStream& stream);
+    bool isNoteActive(int noteNumber);
+    void setSinglePrecision(bool singlePrecision) { this->singlePrecision = singlePrecision; };
+    void setInterleaved(bool interleaved) { this->interleaved = interleaved; };
+    void setModalPlucks(bool modalPlucks) { this->modalPlucks = modalPlucks; };
+    void setSympathetic(double level) { sympatheticLevel = level; };
+    void setSympatheticTuning(const SympatheticTuning& tuning);
+    void setSimulationRate(double simulationFs, Resampler::Quality quality);
+    double getSimulationRate() const { return Fs; };
+    double getLatency() const { return resamplers[0].isActive() ? resamplers[0].getLatency() : 0.0; };
+
+    void process(float* outL, float* outR, int numSamples);
+    void setPickups(const Pickups::Pickup* pickups, int numPickups);
+    Telemetry& getTelemetry() { return telemetry; };
+    void renderJob(int job) override;
+
+    double releaseSig0 = 10.0;  // damping applied on note off
+    double sleepLevel = 1e-10;  // energy relative to the peak below which a voice sleeps, -100 dB
+
+private:
+    void processSimulation(float* outL, float* outR, int numSamples);
+    void renderSympathetic(float* outL, float* outR);
+    void tuneSympathetic(bool retune);
+    StringVoice* findVoice(int noteNumber);
+    StringVoice* findFreeVoice();
+    bool isBankable(StringVoice* voice);
+    void joinBank(StringVoice* voice);
+    void leaveBank(StringVoice* voice);
+    void retune(StringVoice* voice, int noteNumber, double f0);
+    void sleep(StringVoice* voice);
+    void wake(StringVoice* voice);
+    void updateEnergy(StringVoice* voice);
+    void record(int64 ticks);
+    GridCoefficients getGrid(int noteNumber, double f0);
+    int toSimulation(int offset) const;
+
+    OwnedArray<StringVoice> voices;
+    vector<StringVoice*> activeVoices;                  // voices rendered on their own in the current block
+    OwnedArray<StringBank> banks;
+    vector<StringBank*> activeBanks;                    // banks rendered in the current block
+    int numVoiceJobs = 0;
+    CoefficientCache cache;                             // grids of all notes, read at note-on
+    Pickups pickups;                                    // output positions of every voice
+    int maxGridSize = 0;
+
+    RenderWorkers workers;
+    Telemetry telemetry;
+    int64 blockCounter = 0;
+    int numRebuilds = 0;                                // grid rebuilds since the last telemetry record
+    int blockSize = 0;                                  // samples rendered by the current jobs
+    int maxBlockSize = 0;
+
+    double Fs = 48000.0;                                // rate the strings run at
+    double simulationFs = 0.0;                          // requested simulation rate, 0 runs at the host rate
+    Resampler::Quality resamplerQuality = Resampler::medium;
+    Resampler resamplers[2];                            // simulation rate to host rate, per channel
+    vector<float> simulationBuffers[2];                 // left and right block at the simulation rate
+    StringNetwork sympathetic;                          // open strings on a bridge, driven by the voices
+    vector<float> sympatheticBuffers[2];
+    vector<float> bridgeForce;                          // summed voices of the current block
+    double sympatheticLevel = 0.0;                      // 0 leaves the sympathetic strings silent and costs nothing
+    SympatheticTuning sympatheticTuning;
+    int maxHostBlockSize = 0;
+    int fadeLength = 0;                                 // retune crossfade in samples
+    int64 noteCounter = 0;
+    bool singlePrecision = false;                       // precision of newly started voices
+    bool interleaved = true;                            // group double precision voices of close N in banks
+    bool modalPlucks = true;                            // start new voices on the ModalString
+};